@@ -0,0 +1,22 @@
+QT -= gui
+CONFIG -= console
+CONFIG += c++17
+QMAKE_CXXFLAGS += -std=c++17
+QMAKE_CXXFLAGS += -Werror=return-type
+
+include(../vn.pri)
+
+INCLUDEPATH += ../../vn/Reader
+
+SOURCES += \
+    ../../vn/Reader/parser.cpp \
+    ../../vn/Reader/scanner.cpp \
+    ../../vn/Reader/story.cpp \
+    generator.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../vn/Reader/parser.h \
+    ../../vn/Reader/scanner.h \
+    ../../vn/Reader/story.h \
+    generator.h
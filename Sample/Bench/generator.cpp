@@ -0,0 +1,196 @@
+#include "generator.h"
+
+
+namespace {
+
+const char *const words[] = {
+    "the", "a", "you", "merchant", "sword", "gold", "mines", "road", "town",
+    "night", "walk", "look", "say", "quietly", "again", "old", "door", "light",
+    "keeper", "apple", "work", "hard", "finally", "adventure", "shelter", "home",
+};
+
+constexpr int wordCount = sizeof(words) / sizeof(words[0]);
+
+}
+
+
+Generator::Generator(const quint64 seed) :
+    rng_(seed)
+{}
+
+int Generator::uniform(const int min, const int max)
+{
+    return std::uniform_int_distribution<int>(min, max)(rng_);
+}
+
+bool Generator::chance(const double probability)
+{
+    return std::bernoulli_distribution(probability)(rng_);
+}
+
+vn::Text Generator::sentence()
+{
+    vn::Text res;
+    const int n = uniform(3, 24);
+    for (int i = 0; i < n; ++i) {
+        if (i > 0)
+            res += ' ';
+        res += words[uniform(0, wordCount - 1)];
+    }
+    return res;
+}
+
+vn::NodeId Generator::frame(vn::Graph &graph)
+{
+    return graph.add<vn::FrameInterned>(graph.strings(), QString("Frame %1").arg(frames_++), sentence());
+}
+
+vn::NodeId Generator::predicate(vn::Graph &graph)
+{
+    return graph.add<vn::PredicateInterned>(graph.strings(), "Check", sentence());
+}
+
+vn::NodeId Generator::story(vn::Graph &graph, const int nodes)
+{
+    const int first = graph.nodes_.size();
+    const vn::NodeId start = frame(graph);
+    QVector<vn::NodeId> open {start};
+    QVector<vn::NodeId> made {start};
+    const auto left = [&] { return nodes - (graph.nodes_.size() - first); };
+
+    while (left() > 0) {
+        if (open.isEmpty())
+            open.append(made.at(uniform(0, made.size() - 1)));
+        const int ind = uniform(0, open.size() - 1);
+        const vn::NodeId from = open.at(ind);
+        open[ind] = open.last();
+        open.removeLast();
+
+        const int kind = uniform(0, 99);
+        if (kind < 50) {
+            /// NOTE: chain
+            vn::NodeId prev = from;
+            const int n = qMin(uniform(1, 40), left());
+            for (int i = 0; i < n; ++i) {
+                const vn::NodeId id = frame(graph);
+                graph.connect(prev, id);
+                made.append(id);
+                prev = id;
+            }
+            open.append(prev);
+        } else if (kind < 85) {
+            /// NOTE: choice fan, some options behind predicates
+            const int n = uniform(2, 5);
+            for (int i = 0; i < n && left() > 0; ++i) {
+                vn::NodeId src = from;
+                if (left() > 1 && chance(0.2)) {
+                    src = predicate(graph);
+                    graph.connect(from, src);
+                }
+                const vn::NodeId id = frame(graph);
+                graph.connect(src, id);
+                made.append(id);
+                open.append(id);
+            }
+        } else {
+            /// NOTE: hub, options come back to it, one leads further
+            const vn::NodeId hub = frame(graph);
+            graph.connect(from, hub);
+            made.append(hub);
+            const int n = uniform(1, 4);
+            for (int i = 0; i < n && left() > 1; ++i) {
+                const vn::NodeId id = frame(graph);
+                graph.connect(hub, id);
+                graph.connect(id, hub);
+            }
+            if (left() > 0) {
+                const vn::NodeId exit = frame(graph);
+                graph.connect(hub, exit);
+                made.append(exit);
+                open.append(exit);
+            }
+        }
+        if (chance(0.05))
+            graph.connect(made.last(), made.at(uniform(0, made.size() - 1)));
+    }
+    return start;
+}
+
+vn::NodeId Generator::opTree(vn::Graph &graph, const int nodes, const bool deep)
+{
+    /// NOTE: n leaves and n - 1 binary ops
+    const int leaves = qMax(1, (nodes + 1) / 2);
+    QVector<vn::NodeId> pending;
+    pending.reserve(leaves);
+    for (int i = 0; i < leaves; ++i)
+        pending.append(chance(0.5) ? graph.add<vn::Static42>() : graph.add<vn::Static69>());
+
+    while (pending.size() > 1) {
+        const int l = deep ? pending.size() - 1 : uniform(0, pending.size() - 1);
+        const vn::NodeId left = pending.at(l);
+        pending[l] = pending.last();
+        pending.removeLast();
+        const int r = deep ? pending.size() - 1 : uniform(0, pending.size() - 1);
+        const vn::NodeId right = pending.at(r);
+
+        const vn::NodeId op = chance(0.5) ? graph.add<vn::Equal>() : graph.add<vn::NonEqual>();
+        graph.connect(op, left);
+        graph.connect(op, right);
+        pending[r] = op;
+    }
+    return pending.first();
+}
+
+QVector<vn::NodeId> Generator::comparisons(vn::Graph &graph, const int nodes, QVector<vn::NodeId> &counters)
+{
+    const int first = graph.nodes_.size();
+    counters.clear();
+    for (int i = 0; i < 64; ++i)
+        counters.append(graph.add<vn::CounterStatic>(QString("Counter %1").arg(i), "", 0));
+
+    QVector<vn::NodeId> res;
+    while (graph.nodes_.size() - first + 3 <= nodes || res.isEmpty()) {
+        const vn::NodeId op = chance(0.5) ? graph.add<vn::Equal>() : graph.add<vn::NonEqual>();
+        graph.connect(op, counters.at(uniform(0, counters.size() - 1)));
+        graph.connect(op, graph.add<vn::Literal>(vn::Op::Value(uniform(0, 3))));
+        res.append(op);
+    }
+    return res;
+}
+
+void Generator::line(QByteArray &res, const int tab, const int number)
+{
+    res.append(QByteArray(tab, ' '));
+    if (number > 0)
+        res.append(QByteArray::number(number)).append(". ");
+    res.append(sentence().toUtf8());
+    res.append('\n');
+}
+
+QByteArray Generator::script(const int nodes)
+{
+    QByteArray res;
+    line(res, 0, 0);
+    int lines = 1;
+    while (lines < nodes) {
+        if (chance(0.7)) {
+            line(res, 0, 0);
+            lines++;
+            continue;
+        }
+        /// NOTE: options with indented branches under them
+        const int n = uniform(2, 4);
+        for (int i = 1; i <= n && lines < nodes; ++i) {
+            line(res, 0, i);
+            lines++;
+            const int branch = uniform(1, 6);
+            for (int j = 0; j < branch && lines < nodes; ++j) {
+                line(res, 2, 0);
+                lines++;
+            }
+        }
+        line(res, 0, 0);
+        lines++;
+    }
+    return res;
+}
@@ -0,0 +1,49 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include <random>
+
+#include "headers.h"
+
+
+/// NOTE: seeded source of synthetic graphs and scripts,
+/// same seed gives the same output
+class Generator
+{
+public:
+    explicit Generator(const quint64 seed);
+
+    /// NOTE: frames and predicates mixing long chains, choice fans,
+    /// hubs whose options lead back to them (like the shop in Sample)
+    /// and some jumps back to earlier frames. returns the start node
+    vn::NodeId story(vn::Graph &graph, const int nodes);
+
+    /// NOTE: Equal/NonEqual over Static42/Static69 leaves, nodes in total.
+    /// deep makes a chain leaning on one side instead of a random tree.
+    /// returns the root
+    vn::NodeId opTree(vn::Graph &graph, const int nodes, const bool deep);
+
+    /// NOTE: Equal/NonEqual of one of 64 counters and a Literal from 0 to 3,
+    /// nodes in total. ids of the counters go to counters, returns the
+    /// comparisons
+    QVector<vn::NodeId> comparisons(vn::Graph &graph, const int nodes, QVector<vn::NodeId> &counters);
+
+    /// NOTE: text in the format of the Reader's script.md
+    QByteArray script(const int nodes);
+
+private:
+    int uniform(const int min, const int max);
+    bool chance(const double probability);
+    vn::Text sentence();
+    vn::NodeId frame(vn::Graph &graph);
+    vn::NodeId predicate(vn::Graph &graph);
+    void line(QByteArray &res, const int tab, const int number);
+
+    std::mt19937_64 rng_;
+    int frames_ = 0;
+};
+
+#endif // GENERATOR_H
@@ -0,0 +1,477 @@
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QStringList>
+#include <QtDebug>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include "headers.h"
+#include "batch.h"
+#include "binary.h"
+#include "compiledgraph.h"
+#include "bytecode.h"
+#include "explorer.h"
+#include "incremental.h"
+#include "optimizer.h"
+#include "runtime.h"
+#include "savestate.h"
+#include "simulator.h"
+#include "trace.h"
+#include "dot.h"
+#include "traversal.h"
+#include "scanner.h"
+#include "parser.h"
+#include "story.h"
+#include "generator.h"
+
+
+/// NOTE: usage: Bench [--max N] [--seed N] [--out results.json] [--trace trace.json]
+/// the latter needs CONFIG += trace
+///
+/// every case is timed on graphs of growing size until one run
+/// takes at least minNs, results are printed and written as json
+
+
+namespace {
+
+constexpr qint64 minNs = 200 * 1000 * 1000;
+/// NOTE: Compute keeps a map of lazy values and grows quadratic,
+/// larger trees would take minutes
+constexpr int computeMax = 10 * 1000;
+
+struct Result
+{
+    QString name;
+    int nodes = 0;
+    qint64 iterations = 0;
+    qint64 ns = 0;
+};
+
+/// NOTE: visits everything reachable, so the walk itself is timed
+struct Count : vn::Visitor
+{
+    inline void visit(const vn::Node &) override { count_++; }
+    qint64 count_ = 0;
+};
+
+struct StaticCount : vn::StaticVisitor
+{
+    inline void visit(const vn::Node &) { count_++; }
+    qint64 count_ = 0;
+};
+
+void print(const Result &res)
+{
+    const double perIteration = double(res.ns) / res.iterations;
+    std::cout << qPrintable(res.name.leftJustified(20)) << " "
+              << qPrintable(QString::number(res.nodes).rightJustified(9)) << " nodes "
+              << qPrintable(QString::number(perIteration, 'f', 0).rightJustified(14)) << " ns "
+              << qPrintable(QString::number(perIteration / qMax(1, res.nodes), 'f', 2).rightJustified(10)) << " ns/node\n";
+    std::cout.flush();
+}
+
+template <typename F>
+Result measure(const QString &name, const int nodes, F f)
+{
+    Result res;
+    res.name = name;
+    res.nodes = nodes;
+    QElapsedTimer timer;
+    qint64 batch = 1;
+    while (true) {
+        timer.start();
+        for (qint64 i = 0; i < batch; ++i)
+            f();
+        const qint64 ns = timer.nsecsElapsed();
+        if (ns >= minNs || batch >= (1 << 24)) {
+            res.iterations = batch;
+            res.ns = ns;
+            break;
+        }
+        batch *= 2;
+    }
+    print(res);
+    return res;
+}
+
+/// NOTE: for cases changing their input, prepare runs before every
+/// call of f and isn't timed
+template <typename P, typename F>
+Result measure(const QString &name, const int nodes, P prepare, F f)
+{
+    Result res;
+    res.name = name;
+    res.nodes = nodes;
+    QElapsedTimer timer;
+    qint64 batch = 1;
+    while (true) {
+        qint64 ns = 0;
+        for (qint64 i = 0; i < batch; ++i) {
+            prepare();
+            timer.start();
+            f();
+            ns += timer.nsecsElapsed();
+        }
+        if (ns >= minNs || batch >= (1 << 24)) {
+            res.iterations = batch;
+            res.ns = ns;
+            break;
+        }
+        batch *= 2;
+    }
+    print(res);
+    return res;
+}
+
+/// NOTE: kinds, edges and frame texts, what a round trip should keep
+bool isSame(const vn::CompiledGraph &a, const vn::CompiledGraph &b)
+{
+    if (a.size() != b.size() || a.edgeCount() != b.edgeCount())
+        return false;
+    for (vn::NodeId id = 0; id < a.size(); ++id) {
+        if (a.contains(id) != b.contains(id))
+            return false;
+        if (!a.contains(id))
+            continue;
+        if (a.kind(id) != b.kind(id) || a.next(id).size() != b.next(id).size())
+            return false;
+        if (!std::equal(a.next(id).begin(), a.next(id).end(), b.next(id).begin()))
+            return false;
+        if (a.kind(id) == vn::NodeKind::Frame
+                && static_cast<const vn::Frame &>(a.node(id)).text() != static_cast<const vn::Frame &>(b.node(id)).text())
+            return false;
+    }
+    return true;
+}
+
+/// NOTE: the parser of Reader's readTree, building its Story
+int parse(const QByteArray &script)
+{
+    Story story;
+    Scanner scanner(script.constData(), script.constData() + script.size());
+    parseStory(scanner, story);
+    return story.size();
+}
+
+QString json(const QVector<Result> &results)
+{
+    QStringList items;
+    for (const Result &r : results) {
+        const double perIteration = double(r.ns) / r.iterations;
+        items << QString("    {\"name\": \"%1\", \"nodes\": %2, \"iterations\": %3, "
+                         "\"nsPerIteration\": %4, \"nsPerNode\": %5}")
+                 .arg(r.name)
+                 .arg(r.nodes)
+                 .arg(r.iterations)
+                 .arg(perIteration, 0, 'f', 1)
+                 .arg(perIteration / qMax(1, r.nodes), 0, 'f', 3);
+    }
+    return "[\n" + items.join(",\n") + "\n]\n";
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+
+    int max = 1000 * 1000;
+    quint64 seed = 42;
+    QString out;
+    QString trace;
+    for (int i = 1; i + 1 < args.size(); i += 2) {
+        if (args.at(i) == "--max")
+            max = args.at(i + 1).toInt();
+        else if (args.at(i) == "--seed")
+            seed = args.at(i + 1).toULongLong();
+        else if (args.at(i) == "--out")
+            out = args.at(i + 1);
+        else if (args.at(i) == "--trace")
+            trace = args.at(i + 1);
+    }
+    QLoggingCategory::setFilterRules("vn.*.debug=false");
+    vn::Trace::setEnabled(!trace.isEmpty());
+
+    QVector<Result> results;
+    try {
+        for (int nodes = 1000; nodes <= max && nodes <= 10 * 1000 * 1000; nodes *= 10) {
+            results << measure("build", nodes, [&] {
+                Generator generator(seed);
+                vn::Graph graph;
+                generator.story(graph, nodes);
+            });
+
+            Generator generator(seed);
+
+            vn::Graph story;
+            const vn::NodeId start = generator.story(story, nodes);
+            const vn::CompiledGraph frozen = vn::freeze(story);
+
+            results << measure("traverse", nodes, [&] {
+                Count count;
+                vn::traverse(story, start, count);
+            });
+            results << measure("traverse/compiled", nodes, [&] {
+                Count count;
+                vn::traverse(frozen, start, count);
+            });
+            results << measure("traverse/static", nodes, [&] {
+                StaticCount count;
+                vn::traverseStatic(frozen, start, count);
+            });
+            results << measure("freeze", nodes, [&] {
+                vn::freeze(story);
+            });
+            results << measure("graphviz", nodes, [&] {
+                vn::ToGraphViz dot;
+                vn::traverse(story, start, dot);
+                dot.digraphText();
+            });
+            results << measure("dot", nodes, [&] {
+                QBuffer sink;
+                sink.open(QIODevice::WriteOnly);
+                vn::writeDot(story, sink);
+            });
+            /// NOTE: cold start, the file is read back into a graph
+            /// which has to freeze to the same one
+            const QString binaryPath = QDir(QDir::tempPath()).filePath("vn-bench.vngb");
+            results << measure("save", nodes, [&] {
+                vn::saveBinary(story, binaryPath);
+            });
+            vn::Graph loaded;
+            results << measure("load", nodes, [&] {
+                loaded = vn::BinaryGraph(binaryPath).load();
+            });
+            QFile::remove(binaryPath);
+            if (!isSame(frozen, vn::freeze(loaded)))
+                throw vn::Error("Loaded graph differs from the saved one");
+            results << measure("previous", nodes, [&] {
+                for (auto it = story.nodes_.cbegin(); it != story.nodes_.cend(); ++it)
+                    story.previous(it.key());
+            });
+            /// NOTE: points the first choice of every node back at the start
+            /// and rolls it all back, so the story is left as it was
+            results << measure("edit/rollback", nodes, [&] {
+                vn::Graph::Transaction transaction(story);
+                for (auto it = story.connections_.cbegin(); it != story.connections_.cend(); ++it)
+                    story.retarget(it.key(), it->first(), start);
+            });
+
+            /// NOTE: the story has no counters, so every node is one state
+            /// and every frame has to be reached
+            vn::ExploreReport explored;
+            results << measure("explore", nodes, [&] {
+                explored = vn::explore(story, start);
+            });
+            if (explored.truncated || explored.states != story.nodes_.size() || !explored.unreachableFrames.isEmpty())
+                throw vn::Error("Explore missed states of the story");
+
+            for (const bool deep : {false, true}) {
+                vn::Graph ops;
+                const vn::NodeId root = generator.opTree(ops, nodes, deep);
+                const QString suffix = deep ? "/deep" : "/random";
+
+                if (nodes <= computeMax)
+                    results << measure("compute" + suffix, nodes, [&] {
+                        vn::Compute compute;
+                        vn::traverse(ops, root, compute);
+                    });
+                results << measure("compile" + suffix, nodes, [&] {
+                    vn::compile(ops, root);
+                });
+                vn::Evaluator evaluator;
+                const vn::Counters counters;
+                results << measure("evaluate" + suffix, nodes, [&] {
+                    evaluator.value(ops, root, counters);
+                });
+                /// NOTE: optimize adds Literals to the arena of the graph,
+                /// so every run gets a tree of its own, built untimed
+                vn::Graph fresh;
+                vn::NodeId freshRoot = -1;
+                results << measure("optimize" + suffix, nodes, [&] {
+                    fresh = vn::Graph();
+                    freshRoot = Generator(seed).opTree(fresh, nodes, deep);
+                }, [&] {
+                    vn::optimize(fresh, {freshRoot});
+                });
+                const vn::NodeId optimized = vn::optimize(ops, {root}).roots.first();
+                evaluator.clear();
+                results << measure("evaluate/optimized" + suffix, nodes, [&] {
+                    evaluator.value(ops, optimized, counters);
+                });
+            }
+
+            /// NOTE: a few counters change before every read of all
+            /// comparisons. the incremental values, also after a reset,
+            /// have to match ones evaluated from scratch
+            {
+                vn::Graph checks;
+                QVector<vn::NodeId> counterIds;
+                const QVector<vn::NodeId> roots = Generator(seed).comparisons(checks, nodes, counterIds);
+                vn::Counters counters(checks);
+                const QVector<int> initial = counters.values();
+                vn::Incremental incremental(checks, counters);
+                std::mt19937_64 rng(seed);
+                results << measure("incremental", nodes, [&] {
+                    for (int i = 0; i < 4; ++i)
+                        counters.set(counterIds.at(int(rng() % counterIds.size())), int(rng() % 4));
+                    for (const vn::NodeId root : roots)
+                        incremental.value(root);
+                });
+                vn::Evaluator evaluator;
+                const auto check = [&] {
+                    for (const vn::NodeId root : roots)
+                        if (incremental.value(root) != evaluator.value(checks, root, counters))
+                            throw vn::Error(QString("Incremental value of op with id %1 is stale").arg(root));
+                };
+                check();
+                counters.reset(initial);
+                check();
+            }
+
+            const QByteArray script = generator.script(nodes);
+            results << measure("parse", nodes, [&] {
+                parse(script);
+            });
+        }
+
+        /// NOTE: a playthrough of 1000 choices touching a few of 64 counters
+        constexpr int steps = 1000;
+        std::mt19937_64 rng(seed);
+        QVector<vn::SaveState> states(steps + 1);
+        states[0].counters.fill(0, 64);
+        for (int i = 1; i <= steps; ++i) {
+            states[i] = states[i - 1];
+            states[i].node = int(rng() % 1000);
+            states[i].choices.append(int(rng() % 4));
+            states[i].counters[int(rng() % 64)] += int(rng() % 21) - 10;
+        }
+        results << measure("savestate", steps, [&] {
+            vn::SaveState state;
+            vn::loadState(vn::saveState(states.last()), state);
+        });
+        vn::StateRing ring;
+        results << measure("push/rewind", steps, [&] {
+            ring.reset(states.first());
+            for (int i = 1; i <= steps; ++i)
+                ring.push(states.at(i));
+            ring.rewind(steps);
+        });
+
+        /// NOTE: 1024 playthroughs with random values of 64 counters, checked
+        /// by comparisons of 10k nodes and by a predicate of every counter
+        /// with every option. every bit has to match the scalar result
+        constexpr int stateCount = 1024;
+        vn::Graph checks;
+        QVector<vn::NodeId> counterIds;
+        const QVector<vn::NodeId> roots = Generator(seed).comparisons(checks, 10 * 1000, counterIds);
+        QVector<const vn::PredicateCompare *> predicates;
+        for (const vn::NodeId id : counterIds) {
+            for (int option = vn::PredicateCompare::Greater; option <= vn::PredicateCompare::NonEqual; ++option) {
+                auto *predicate = new vn::PredicateCompare;
+                predicate->nodeId_ = id;
+                predicate->valueToCompare_ = int(rng() % 4);
+                predicate->compareOption_ = vn::PredicateCompare::CompareOption(option);
+                checks.add(predicate);
+                predicates.append(predicate);
+            }
+        }
+        QVector<vn::Counters> playthroughs(stateCount, vn::Counters(checks));
+        vn::CounterStates block(counterIds, stateCount);
+        for (int i = 0; i < stateCount; ++i) {
+            for (const vn::NodeId id : counterIds)
+                playthroughs[i].set(id, int(rng() % 4));
+            block.set(i, playthroughs.at(i));
+        }
+        vn::Evaluator evaluator;
+        QVector<vn::Program> programs;
+        for (const vn::NodeId root : roots)
+            programs.append(evaluator.program(checks, root));
+        vn::BatchEvaluator batch;
+        QVector<vn::Mask> masks;
+        results << measure("batch/predicates", stateCount, [&] {
+            masks = batch.evaluate(predicates, block);
+        });
+        QVector<vn::Mask> programMasks(programs.size());
+        results << measure("batch/programs", stateCount, [&] {
+            for (int i = 0; i < programs.size(); ++i)
+                programMasks[i] = batch.evaluate(programs.at(i), block);
+        });
+        const auto isSet = [](const vn::Mask &mask, const int state) {
+            return ((mask.at(state / 64) >> (state % 64)) & 1) != 0;
+        };
+        for (int i = 0; i < stateCount; ++i) {
+            for (int j = 0; j < predicates.size(); ++j)
+                if (isSet(masks.at(j), i) != predicates.at(j)->isOk(playthroughs.at(i)))
+                    throw vn::Error(QString("Batch result of predicate %1 differs in state %2").arg(j).arg(i));
+            for (int j = 0; j < roots.size(); ++j)
+                if (isSet(programMasks.at(j), i) != (evaluator.value(checks, roots.at(j), playthroughs.at(i)) == vn::Scalar::ofBool(true)))
+                    throw vn::Error(QString("Batch result of op with id %1 differs in state %2").arg(roots.at(j)).arg(i));
+        }
+
+        /// NOTE: 10k sessions over one story, each takes a pseudo random
+        /// option per run and starts over once it has none
+        constexpr int sessionCount = 10 * 1000;
+        vn::Graph graph;
+        const vn::NodeId first = Generator(seed).story(graph, 10 * 1000);
+        const vn::Runtime runtime(std::move(graph), first);
+        vn::Scheduler scheduler(runtime);
+        QVector<vn::SaveState> sessions(sessionCount, runtime.begin());
+        results << measure("sessions", sessionCount, [&] {
+            scheduler.advance(sessions, [&](vn::SaveState &session, const int index, vn::Counters &scratch, int) {
+                const int count = runtime.optionCount(session, scratch);
+                if (count == 0) {
+                    session = runtime.begin();
+                    return;
+                }
+                const quint32 pick = quint32(index) * 2654435761u ^ quint32(session.choices.size());
+                runtime.choose(session, int(pick % quint32(count)), scratch);
+            });
+        });
+        qint64 bytes = 0;
+        for (const vn::SaveState &session : sessions)
+            bytes += vn::Runtime::bytes(session);
+        std::cout << "sessions on " << scheduler.threads() << " threads, "
+                  << bytes / sessionCount << " bytes per session\n";
+
+        /// NOTE: random walks over the same story, uniform choices
+        vn::SimulateOptions simulation;
+        simulation.walks = 100 * 1000;
+        simulation.seed = seed;
+        vn::SimulateReport walks;
+        const Result simulated = measure("simulate", int(simulation.walks), [&] {
+            walks = vn::simulate(runtime.graph(), first, simulation);
+        });
+        results << simulated;
+        std::cout << "simulate " << qint64(1e9 * simulated.iterations * simulation.walks / simulated.ns)
+                  << " walks/s, length p50 " << walks.percentile(0.5)
+                  << " p90 " << walks.percentile(0.9)
+                  << " p99 " << walks.percentile(0.99)
+                  << ", " << walks.endings.size() << " endings, "
+                  << walks.visits.size() << " frames visited\n";
+
+        if (!trace.isEmpty())
+            vn::Trace::saveChromeTrace(trace);
+    } catch (const vn::Error &err) {
+        qDebug() << err.message;
+        return 1;
+    }
+
+    if (!out.isEmpty()) {
+        QFile file(out);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qDebug() << "can't write" << out;
+            return 1;
+        }
+        file.write(json(results).toUtf8());
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+QT -= gui
+TEMPLATE = lib
+CONFIG += staticlib
+CONFIG += c++17
+QMAKE_CXXFLAGS += -std=c++17
+QMAKE_CXXFLAGS += -Werror=return-type
+
+TARGET = vnruntime
+
+# the whole core with runtime.h on top, for hosts running
+# many sessions without the Sample app or the Reader
+include(../vn.pri)
@@ -4,8 +4,6 @@ CONFIG += c++17
 QMAKE_CXXFLAGS += -std=c++17
 QMAKE_CXXFLAGS += -Werror=return-type
 
-SOURCES += main.cpp
+include(vn.pri)
 
-HEADERS += \
-    headers.h \
-    utils.h
+SOURCES += main.cpp
@@ -0,0 +1,70 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+
+vn::Arena::Arena(Arena &&other) noexcept
+{
+    swap(other);
+}
+
+vn::Arena &vn::Arena::operator=(Arena &&other) noexcept
+{
+    Arena(std::move(other)).swap(*this);
+    return *this;
+}
+
+vn::Arena::~Arena()
+{
+    finalize();
+    for (const Block &block : blocks_)
+        ::operator delete(block.begin);
+}
+
+void vn::Arena::clear()
+{
+    finalize();
+    if (blocks_.isEmpty())
+        return;
+    for (int i = 1; i < blocks_.size(); ++i)
+        ::operator delete(blocks_[i].begin);
+    blocks_.resize(1);
+    pos_ = blocks_.first().begin;
+    end_ = pos_ + blocks_.first().size;
+    capacity_ = blocks_.first().size;
+}
+
+void *vn::Arena::allocate(const std::size_t size, const std::size_t align)
+{
+    std::uintptr_t at = (reinterpret_cast<std::uintptr_t>(pos_) + align - 1) & ~std::uintptr_t(align - 1);
+    if (pos_ == nullptr || at + size > reinterpret_cast<std::uintptr_t>(end_)) {
+        /// NOTE: blocks double up to the limit, bigger objects get one of their own
+        const std::size_t last = blocks_.isEmpty() ? firstBlockSize / 2 : blocks_.last().size;
+        const std::size_t blockSize = std::max(std::min(last * 2, maxBlockSize), size);
+        char *begin = static_cast<char *>(::operator new(blockSize));
+        blocks_.append({begin, blockSize});
+        capacity_ += blockSize;
+        pos_ = begin;
+        end_ = begin + blockSize;
+        at = reinterpret_cast<std::uintptr_t>(pos_);
+    }
+    pos_ = reinterpret_cast<char *>(at + size);
+    return reinterpret_cast<void *>(at);
+}
+
+void vn::Arena::finalize()
+{
+    for (int i = finalizers_.size() - 1; i >= 0; --i)
+        finalizers_[i].call(finalizers_[i].object);
+    finalizers_.clear();
+}
+
+void vn::Arena::swap(Arena &other) noexcept
+{
+    std::swap(blocks_, other.blocks_);
+    std::swap(finalizers_, other.finalizers_);
+    std::swap(pos_, other.pos_);
+    std::swap(end_, other.end_);
+    std::swap(capacity_, other.capacity_);
+}
@@ -0,0 +1,86 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QVector>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: bump allocator, objects are placed one after another
+/// in large blocks and destroyed all together in reverse order.
+/// nothing is freed one by one
+class Arena
+{
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    Arena(Arena &&other) noexcept;
+    Arena &operator=(Arena &&other) noexcept;
+    ~Arena();
+
+    template <typename T, typename ...Args>
+    T *make(Args &&...args)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+        void *place = allocate(sizeof(T), alignof(T));
+        T *res = new (place) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value)
+            finalizers_.append({res, &destroy<T>});
+        return res;
+    }
+
+    /// NOTE: object made with new elsewhere, deleted together with the arena
+    template <typename T>
+    void adopt(T *object)
+    {
+        finalizers_.append({object, &release<T>});
+    }
+
+    /// NOTE: destroys everything, keeps the first block for reuse
+    void clear();
+    /// NOTE: bytes taken from the system, not the bytes in use
+    inline std::size_t capacity() const { return capacity_; }
+
+private:
+    struct Block
+    {
+        char *begin;
+        std::size_t size;
+    };
+    struct Finalizer
+    {
+        void *object;
+        void (*call)(void *);
+    };
+
+    template <typename T>
+    static void destroy(void *object) { static_cast<T *>(object)->~T(); }
+    template <typename T>
+    static void release(void *object) { delete static_cast<T *>(object); }
+
+    void *allocate(const std::size_t size, const std::size_t align);
+    void finalize();
+    void swap(Arena &other) noexcept;
+
+    static constexpr std::size_t firstBlockSize = 4 * 1024;
+    static constexpr std::size_t maxBlockSize = 1024 * 1024;
+
+    QVector<Block> blocks_;
+    QVector<Finalizer> finalizers_;
+    char *pos_ = nullptr;
+    char *end_ = nullptr;
+    std::size_t capacity_ = 0;
+};
+
+}
+
+
+namespace vn = VisualNovelGraph;
+
+#endif // ARENA_H
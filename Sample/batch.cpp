@@ -0,0 +1,278 @@
+#include "batch.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/// NOTE: kernels below are built for the target baseline (SSE2 on x86-64)
+/// and once more for AVX2, picked at runtime
+#if defined(__GNUC__) && defined(__x86_64__)
+#define VN_BATCH_AVX2
+#endif
+
+
+namespace {
+
+using namespace vn;
+
+enum RawCompare {
+    RawGreater,
+    RawLess,
+    RawEqual,
+};
+
+template <RawCompare C>
+inline bool compareScalar(const int l, const int r)
+{
+    switch (C) {
+    case RawGreater: return l > r;
+    case RawLess:    return l < r;
+    case RawEqual:   return l == r;
+    }
+    return false;
+}
+
+/// NOTE: sets bit i of bits when values[i] compares to value,
+/// bits past count stay unset
+template <RawCompare C>
+void compareSse(const int *values, const int count, const int value, quint64 *bits)
+{
+    const int words = (count + 63) / 64;
+    for (int w = 0; w < words; ++w) {
+        const int begin = w * 64;
+        const int end = qMin(begin + 64, count);
+        quint64 word = 0;
+        int i = begin;
+#if defined(__SSE2__)
+        const __m128i v = _mm_set1_epi32(value);
+        for (; i + 4 <= end; i += 4) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+            const __m128i m = C == RawGreater ? _mm_cmpgt_epi32(x, v)
+                            : C == RawLess    ? _mm_cmplt_epi32(x, v)
+                            :                   _mm_cmpeq_epi32(x, v);
+            word |= quint64(_mm_movemask_ps(_mm_castsi128_ps(m))) << (i - begin);
+        }
+#endif
+        for (; i < end; ++i)
+            word |= quint64(compareScalar<C>(values[i], value)) << (i - begin);
+        bits[w] = word;
+    }
+}
+
+#ifdef VN_BATCH_AVX2
+template <RawCompare C>
+__attribute__((target("avx2")))
+void compareAvx2(const int *values, const int count, const int value, quint64 *bits)
+{
+    const int words = (count + 63) / 64;
+    const __m256i v = _mm256_set1_epi32(value);
+    for (int w = 0; w < words; ++w) {
+        const int begin = w * 64;
+        const int end = qMin(begin + 64, count);
+        quint64 word = 0;
+        int i = begin;
+        for (; i + 8 <= end; i += 8) {
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+            const __m256i m = C == RawGreater ? _mm256_cmpgt_epi32(x, v)
+                            : C == RawLess    ? _mm256_cmpgt_epi32(v, x)
+                            :                   _mm256_cmpeq_epi32(x, v);
+            word |= quint64(quint32(_mm256_movemask_ps(_mm256_castsi256_ps(m)))) << (i - begin);
+        }
+        for (; i < end; ++i)
+            word |= quint64(compareScalar<C>(values[i], value)) << (i - begin);
+        bits[w] = word;
+    }
+}
+#endif
+
+template <RawCompare C>
+void compareRaw(const int *values, const int count, const int value, quint64 *bits)
+{
+#ifdef VN_BATCH_AVX2
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if (hasAvx2)
+        return compareAvx2<C>(values, count, value, bits);
+#endif
+    return compareSse<C>(values, count, value, bits);
+}
+
+void invert(quint64 *bits, const int count)
+{
+    const int words = (count + 63) / 64;
+    for (int w = 0; w < words; ++w)
+        bits[w] = ~bits[w];
+    if (count % 64)
+        bits[words - 1] &= (quint64(1) << (count % 64)) - 1;
+}
+
+void compareOption(
+        const PredicateCompare::CompareOption option,
+        const int *values,
+        const int count,
+        const int value,
+        quint64 *bits)
+{
+    switch (option) {
+    case PredicateCompare::Greater:
+        return compareRaw<RawGreater>(values, count, value, bits);
+    case PredicateCompare::Less:
+        return compareRaw<RawLess>(values, count, value, bits);
+    case PredicateCompare::Equal:
+        return compareRaw<RawEqual>(values, count, value, bits);
+    case PredicateCompare::GreaterOrEqual:
+        compareRaw<RawLess>(values, count, value, bits);
+        return invert(bits, count);
+    case PredicateCompare::LessOrEqual:
+        compareRaw<RawGreater>(values, count, value, bits);
+        return invert(bits, count);
+    case PredicateCompare::NonEqual:
+        compareRaw<RawEqual>(values, count, value, bits);
+        return invert(bits, count);
+    }
+    throw Error(QString("Unknown predicate compare option: %1").arg(option));
+}
+
+}
+
+
+vn::CounterStates::CounterStates(const QVector<NodeId> &counters, const int count) :
+    counters_(counters),
+    count_(count),
+    stride_((count + 63) / 64 * 64)
+{
+    for (int i = 0; i < counters_.size(); ++i)
+        columns_.insert(counters_.at(i), i);
+    values_.fill(0, counters_.size() * stride_);
+}
+
+int vn::CounterStates::column(const NodeId counter) const
+{
+    const int ind = columns_.value(counter, -1);
+    if (ind < 0)
+        throw Error(QString("Missing counter with id %1 in states").arg(counter));
+    return ind;
+}
+
+const int *vn::CounterStates::values(const NodeId counter) const
+{
+    return values_.constData() + column(counter) * stride_;
+}
+
+int *vn::CounterStates::values(const NodeId counter)
+{
+    return values_.data() + column(counter) * stride_;
+}
+
+void vn::CounterStates::set(const int state, const NodeId counter, const int value)
+{
+    Q_ASSERT(state >= 0 && state < count_);
+    values(counter)[state] = value;
+}
+
+void vn::CounterStates::set(const int state, const Counters &counters)
+{
+    Q_ASSERT(state >= 0 && state < count_);
+    for (int i = 0; i < counters_.size(); ++i)
+        values_[i * stride_ + state] = counters.value(counters_.at(i));
+}
+
+vn::Mask vn::BatchEvaluator::evaluate(const PredicateCompare &predicate, const CounterStates &states)
+{
+    Mask mask(states.words());
+    compareOption(predicate.compareOption_,
+            states.values(predicate.nodeId_),
+            states.count(),
+            predicate.valueToCompare_,
+            mask.data());
+    return mask;
+}
+
+QVector<vn::Mask> vn::BatchEvaluator::evaluate(
+        const QVector<const PredicateCompare *> &predicates,
+        const CounterStates &states)
+{
+    QVector<Mask> res;
+    res.reserve(predicates.size());
+    for (const PredicateCompare *predicate : predicates)
+        res.push_back(evaluate(*predicate, states));
+    return res;
+}
+
+int *vn::BatchEvaluator::scratch(const int ind, const int stride)
+{
+    return scratch_.data() + ind * stride;
+}
+
+vn::Mask vn::BatchEvaluator::evaluate(const Program &program, const CounterStates &states)
+{
+    const int n = states.count();
+    const int stride = states.stride();
+    const int columns = program.stackSize_ + program.slotCount_;
+    if (scratch_.size() < columns * stride)
+        scratch_.resize(columns * stride);
+    stack_.clear();
+    slots_.resize(program.slotCount_);
+
+    /// NOTE: stack column ind is written to scratch column ind,
+    /// slot column ind to scratch column stackSize_ + ind.
+    /// kinds only depend on the program, so they are tracked per column
+    for (const Instruction &ins : program.code_) {
+        switch (ins.code) {
+        case Instruction::PushInt:
+        case Instruction::PushBool: {
+            int *out = scratch(stack_.size(), stride);
+            std::fill(out, out + n, ins.arg);
+            stack_.push_back({ins.code == Instruction::PushInt ? Column::Int : Column::Bool, out});
+            break;
+        }
+        case Instruction::LoadCounter:
+            stack_.push_back({Column::Int, states.values(ins.arg)});
+            break;
+        case Instruction::Equal:
+        case Instruction::NonEqual: {
+            const Column r = stack_.takeLast();
+            const Column l = stack_.takeLast();
+            int *out = scratch(stack_.size(), stride);
+            if (l.kind == Column::Error || r.kind == Column::Error || l.kind != r.kind) {
+                stack_.push_back({Column::Error, out});
+                break;
+            }
+            const int *a = l.values;
+            const int *b = r.values;
+            if (ins.code == Instruction::Equal) {
+                for (int i = 0; i < n; ++i)
+                    out[i] = a[i] == b[i];
+            } else {
+                for (int i = 0; i < n; ++i)
+                    out[i] = a[i] != b[i];
+            }
+            stack_.push_back({Column::Bool, out});
+            break;
+        }
+        case Instruction::Store: {
+            const Column top = stack_.last();
+            int *out = scratch(program.stackSize_ + ins.arg, stride);
+            if (top.kind != Column::Error)
+                std::copy(top.values, top.values + n, out);
+            slots_[ins.arg] = {top.kind, out};
+            break;
+        }
+        case Instruction::Load:
+            stack_.push_back(slots_.at(ins.arg));
+            break;
+        case Instruction::Drop:
+            stack_.resize(stack_.size() - ins.arg);
+            break;
+        case Instruction::Fail:
+            stack_.push_back({Column::Error, scratch(stack_.size(), stride)});
+            break;
+        }
+    }
+    Q_ASSERT(stack_.size() == 1);
+
+    Mask mask(states.words());
+    const Column &res = stack_.last();
+    if (res.kind == Column::Bool)
+        compareRaw<RawEqual>(res.values, n, 1, mask.data());
+    return mask;
+}
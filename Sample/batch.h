@@ -0,0 +1,68 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QVector>
+#include <QHash>
+
+#include "headers.h"
+#include "bytecode.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: bit i of a mask is set when state i satisfies the predicate
+using Mask = QVector<quint64>;
+
+
+/// NOTE: struct of arrays block of counter states, values of one
+/// counter over all states are contiguous and padded to whole mask words
+class CounterStates
+{
+public:
+    CounterStates(const QVector<NodeId> &counters, const int count);
+    inline int count() const                 { return count_; }
+    inline int stride() const                { return stride_; }
+    inline int words() const                 { return stride_ / 64; }
+    inline QVector<NodeId> counters() const  { return counters_; }
+    const int *values(const NodeId counter) const;
+    int *values(const NodeId counter);
+    void set(const int state, const NodeId counter, const int value);
+    /// NOTE: state takes the values of all counters of the block
+    void set(const int state, const Counters &counters);
+private:
+    int column(const NodeId counter) const;
+
+    QVector<NodeId> counters_;
+    QHash<NodeId, int> columns_;
+    QVector<int> values_;
+    int count_ = 0;
+    int stride_ = 0;
+};
+
+
+/// NOTE: evaluates predicates over all states of a block at once.
+/// keeps column buffers between calls
+class BatchEvaluator
+{
+public:
+    BatchEvaluator() = default;
+    Mask evaluate(const PredicateCompare &predicate, const CounterStates &states);
+    QVector<Mask> evaluate(const QVector<const PredicateCompare *> &predicates, const CounterStates &states);
+    /// NOTE: states where program evaluates to anything but true are unset
+    Mask evaluate(const Program &program, const CounterStates &states);
+private:
+    struct Column
+    {
+        enum Kind { Int, Bool, Error } kind;
+        const int *values;
+    };
+    int *scratch(const int ind, const int stride);
+
+    QVector<int> scratch_;
+    QVector<Column> stack_;
+    QVector<Column> slots_;
+};
+
+}
+
+#endif // BATCH_H
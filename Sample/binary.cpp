@@ -0,0 +1,314 @@
+#include "binary.h"
+
+#include <QSaveFile>
+#include <QByteArray>
+#include <QtEndian>
+
+#include <limits>
+
+
+namespace {
+
+using namespace vn;
+
+static_assert(sizeof(Binary::Header) == 72, "Header layout changed");
+static_assert(sizeof(Binary::NodeRecord) == 24, "NodeRecord layout changed");
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "Format is written as in memory");
+static_assert(std::is_same<std::variant_alternative_t<1, Op::Value>, bool>::value
+              && std::is_same<std::variant_alternative_t<2, Op::Value>, int>::value,
+              "Literal options are indices into Op::Value");
+
+quint64 align(const quint64 offset)
+{
+    return (offset + 7) & ~quint64(7);
+}
+
+struct Record : Visitor
+{
+    void visit(const Frame &frame) override
+    {
+        title = frame.title();
+        text = frame.text();
+    }
+    void visit(const Predicate &predicate) override
+    {
+        title = predicate.title();
+        text = predicate.text();
+    }
+    void visit(const PredicateCompare &predicate) override
+    {
+        visit(static_cast<const Predicate &>(predicate));
+        record.a = predicate.nodeId_;
+        record.b = predicate.valueToCompare_;
+        record.option = quint8(predicate.compareOption_);
+    }
+    void visit(const Counter &counter) override
+    {
+        title = counter.title();
+        text = counter.description();
+        record.a = counter.initialValue();
+    }
+    void visit(const AdvanceAdd &advance) override
+    {
+        record.a = advance.counterId_;
+        record.b = advance.delta_;
+    }
+    void visit(const Literal &literal) override
+    {
+        record.option = quint8(literal.value_.index());
+        if (const bool *value = std::get_if<bool>(&literal.value_))
+            record.a = *value;
+        else if (const int *value = std::get_if<int>(&literal.value_))
+            record.a = *value;
+        else
+            title = std::get<Text>(literal.value_);
+    }
+    Binary::NodeRecord record {};
+    Text title;
+    Text text;
+};
+
+void write(QIODevice &device, const quint64 offset, const char *data, const qint64 size)
+{
+    static const char zeros[8] = {};
+    const qint64 pad = qint64(offset) - device.pos();
+    Q_ASSERT(pad >= 0 && pad < 8);
+    if (device.write(zeros, pad) != pad || device.write(data, size) != size)
+        throw Error(QString("Failed to write compiled graph: %1").arg(device.errorString()));
+}
+
+}
+
+
+void vn::saveBinary(const Graph &graph, const QString &filePath)
+{
+    const int n = graph.nodes_.isEmpty() ? 0 : (graph.nodes_.lastKey() + 1);
+    QVector<Binary::NodeRecord> nodes(n, Binary::NodeRecord {});
+    QVector<quint32> offsets(n + 1, 0);
+    QVector<NodeId> targets;
+    /// NOTE: equal strings are written once
+    StringPool strings;
+
+    for (NodeId id = 0; id < n; ++id) {
+        offsets[id] = quint32(targets.size());
+        const Node *node = graph.nodes_.value(id, nullptr);
+        if (node == nullptr) {
+            nodes[id].title = nodes[id].text = Binary::noString;
+            continue;
+        }
+        Record record;
+        node->accept(record);
+        record.record.kind = quint8(kindOf(*node));
+        record.record.title = strings.add(record.title);
+        record.record.text = strings.add(record.text);
+        nodes[id] = record.record;
+        targets.append(graph.next(id));
+    }
+    offsets[n] = quint32(targets.size());
+    static_assert(StringPool::none == Binary::noString, "Missing strings are stored as is");
+
+    Binary::Header header {};
+    header.magic = Binary::magic;
+    header.version = Binary::version;
+    header.nodeCount = quint32(n);
+    header.edgeCount = quint32(targets.size());
+    header.stringCount = quint32(strings.count());
+    header.blobSize = quint32(strings.blob().size());
+    header.nodesOffset = align(sizeof(Binary::Header));
+    header.offsetsOffset = align(header.nodesOffset + sizeof(Binary::NodeRecord) * quint64(n));
+    header.targetsOffset = align(header.offsetsOffset + sizeof(quint32) * quint64(n + 1));
+    header.stringsOffset = align(header.targetsOffset + sizeof(NodeId) * quint64(targets.size()));
+    header.blobOffset = align(header.stringsOffset + sizeof(quint32) * quint64(strings.offsets().size()));
+    header.fileSize = header.blobOffset + quint64(strings.blob().size());
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        throw Error(QString("Failed to open %1 for writing: %2").arg(filePath).arg(file.errorString()));
+    const auto bytes = [](const auto &vector) {
+        return qint64(sizeof(vector[0])) * vector.size();
+    };
+    write(file, 0, reinterpret_cast<const char *>(&header), sizeof(header));
+    write(file, header.nodesOffset, reinterpret_cast<const char *>(nodes.constData()), bytes(nodes));
+    write(file, header.offsetsOffset, reinterpret_cast<const char *>(offsets.constData()), bytes(offsets));
+    write(file, header.targetsOffset, reinterpret_cast<const char *>(targets.constData()), bytes(targets));
+    write(file, header.stringsOffset, reinterpret_cast<const char *>(strings.offsets().constData()), bytes(strings.offsets()));
+    write(file, header.blobOffset, strings.blob().constData(), strings.blob().size());
+    if (!file.commit())
+        throw Error(QString("Failed to save %1: %2").arg(filePath).arg(file.errorString()));
+}
+
+vn::BinaryGraph::BinaryGraph(const QString &filePath) :
+    file_(filePath)
+{
+    if (!file_.open(QIODevice::ReadOnly))
+        throw Error(QString("Failed to open %1: %2").arg(filePath).arg(file_.errorString()));
+    const qint64 size = file_.size();
+    if (size < qint64(sizeof(Binary::Header)))
+        throw Error(QString("%1 is too small for a compiled graph").arg(filePath));
+    data_ = file_.map(0, size);
+    if (data_ == nullptr)
+        throw Error(QString("Failed to map %1: %2").arg(filePath).arg(file_.errorString()));
+
+    header_ = reinterpret_cast<const Binary::Header *>(data_);
+    validate(size);
+}
+
+void vn::BinaryGraph::validate(const qint64 size)
+{
+    const Binary::Header &h = *header_;
+    if (h.magic != Binary::magic)
+        throw Error("Not a compiled graph");
+    if (h.version != Binary::version)
+        throw Error(QString("Unsupported compiled graph version %1").arg(h.version));
+    if (h.fileSize != quint64(size))
+        throw Error("Compiled graph is truncated");
+
+    /// NOTE: counts are 32 bit, so sizes below can't overflow 64 bit
+    const auto fits = [&h](const quint64 offset, const quint64 bytes) {
+        return offset % 8 == 0 && offset >= sizeof(Binary::Header)
+                && offset <= h.fileSize && bytes <= h.fileSize - offset;
+    };
+    if (!fits(h.nodesOffset, sizeof(Binary::NodeRecord) * quint64(h.nodeCount))
+            || !fits(h.offsetsOffset, sizeof(quint32) * (quint64(h.nodeCount) + 1))
+            || !fits(h.targetsOffset, sizeof(NodeId) * quint64(h.edgeCount))
+            || !fits(h.stringsOffset, sizeof(quint32) * (quint64(h.stringCount) + 1))
+            || !fits(h.blobOffset, quint64(h.blobSize)))
+        throw Error("Compiled graph has sections out of file bounds");
+    if (h.nodeCount > quint32(std::numeric_limits<NodeId>::max()))
+        throw Error("Compiled graph has too many nodes");
+
+    nodes_ = reinterpret_cast<const Binary::NodeRecord *>(data_ + h.nodesOffset);
+    offsets_ = reinterpret_cast<const quint32 *>(data_ + h.offsetsOffset);
+    targets_ = reinterpret_cast<const NodeId *>(data_ + h.targetsOffset);
+    strings_ = reinterpret_cast<const quint32 *>(data_ + h.stringsOffset);
+    blob_ = reinterpret_cast<const char *>(data_ + h.blobOffset);
+
+    /// NOTE: contents are checked once sections are known to fit
+    const quint32 n = h.nodeCount;
+    if (offsets_[0] != 0 || offsets_[n] != h.edgeCount)
+        throw Error("Compiled graph has broken edge offsets");
+    for (quint32 id = 0; id < n; ++id) {
+        if (offsets_[id] > offsets_[id + 1])
+            throw Error(QString("Compiled graph has broken edge offsets at node %1").arg(id));
+        const Binary::NodeRecord &node = nodes_[id];
+        if (node.kind > quint8(NodeKind::Literal))
+            throw Error(QString("Compiled graph has unknown kind of node %1").arg(id));
+        /// NOTE: enums stored in option, read back as is
+        const NodeKind kind = NodeKind(node.kind);
+        if ((kind == NodeKind::PredicateCompare && node.option > PredicateCompare::NonEqual)
+                || (kind == NodeKind::Literal && node.option >= std::variant_size_v<Op::Value>))
+            throw Error(QString("Compiled graph has unknown option of node %1").arg(id));
+        if ((node.title != Binary::noString && node.title >= h.stringCount)
+                || (node.text != Binary::noString && node.text >= h.stringCount))
+            throw Error(QString("Compiled graph has broken strings of node %1").arg(id));
+    }
+    for (quint32 i = 0; i < h.edgeCount; ++i)
+        if (quint32(targets_[i]) >= n)
+            throw Error(QString("Compiled graph has edge %1 to a missing node").arg(i));
+    if (strings_[0] != 0 || strings_[h.stringCount] != h.blobSize)
+        throw Error("Compiled graph has broken string offsets");
+    for (quint32 i = 0; i < h.stringCount; ++i)
+        if (strings_[i] > strings_[i + 1])
+            throw Error(QString("Compiled graph has broken string %1").arg(i));
+}
+
+vn::Graph vn::BinaryGraph::load() const
+{
+    Graph res;
+    StringPool &pool = res.strings();
+    for (NodeId id = 0; id < size(); ++id) {
+        const Binary::NodeRecord &record = nodes_[id];
+        NodeId added = -1;
+        switch (kind(id)) {
+        case NodeKind::None:
+            /// NOTE: the id is taken and dropped, so the next ones keep theirs
+            res.remove(res.add<Static42>());
+            continue;
+        case NodeKind::Frame:
+            added = res.add<FrameInterned>(pool, title(id), text(id));
+            break;
+        case NodeKind::Predicate:
+            added = res.add<PredicateInterned>(pool, title(id), text(id));
+            break;
+        case NodeKind::PredicateCompare: {
+            auto *predicate = new PredicateCompare;
+            predicate->title_ = title(id);
+            predicate->text_ = text(id);
+            predicate->nodeId_ = record.a;
+            predicate->valueToCompare_ = record.b;
+            predicate->compareOption_ = PredicateCompare::CompareOption(record.option);
+            added = res.add(predicate);
+            break;
+        }
+        case NodeKind::Counter:
+            added = res.add<CounterStatic>(title(id), text(id), record.a);
+            break;
+        case NodeKind::Advance:
+            throw Error(QString("Advance with id %1 is of unknown kind").arg(id));
+        case NodeKind::AdvanceAdd:
+            added = res.add<AdvanceAdd>(record.a, record.b);
+            break;
+        case NodeKind::Op:
+            added = res.add<Op>();
+            break;
+        case NodeKind::Equal:
+            added = res.add<Equal>();
+            break;
+        case NodeKind::NonEqual:
+            added = res.add<NonEqual>();
+            break;
+        case NodeKind::Static42:
+            added = res.add<Static42>();
+            break;
+        case NodeKind::Static69:
+            added = res.add<Static69>();
+            break;
+        case NodeKind::Literal: {
+            /// NOTE: the type is checked by validate()
+            Op::Value value = title(id);
+            if (record.option == 1)
+                value = bool(record.a);
+            else if (record.option == 2)
+                value = int(record.a);
+            added = res.add<Literal>(value);
+            break;
+        }
+        }
+        Q_ASSERT(added == id);
+        Q_UNUSED(added)
+    }
+    for (NodeId id = 0; id < size(); ++id)
+        for (const NodeId dst : next(id))
+            res.connect(id, dst);
+    return res;
+}
+
+vn::Span<vn::NodeId> vn::BinaryGraph::next(const NodeId id) const
+{
+    if (id < 0 || id >= size())
+        return {};
+    return Span<NodeId>(targets_ + offsets_[id], int(offsets_[id + 1] - offsets_[id]));
+}
+
+vn::Span<char> vn::BinaryGraph::utf8(const quint32 string) const
+{
+    if (string >= header_->stringCount)
+        return {};
+    return Span<char>(blob_ + strings_[string], int(strings_[string + 1] - strings_[string]));
+}
+
+vn::Text vn::BinaryGraph::title(const NodeId id) const
+{
+    if (id < 0 || id >= size())
+        return {};
+    const Span<char> bytes = utf8(nodes_[id].title);
+    return Text::fromUtf8(bytes.begin(), bytes.size());
+}
+
+vn::Text vn::BinaryGraph::text(const NodeId id) const
+{
+    if (id < 0 || id >= size())
+        return {};
+    const Span<char> bytes = utf8(nodes_[id].text);
+    return Text::fromUtf8(bytes.begin(), bytes.size());
+}
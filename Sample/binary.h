@@ -0,0 +1,108 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <QFile>
+#include <QString>
+
+#include "headers.h"
+#include "utils.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: layout of a compiled graph file. all sections are arrays of
+/// little endian plain structs, 8 byte aligned, at offsets from the
+/// file start given in the header:
+///  - nodes: one record per NodeId, NodeKind::None for missing ids
+///  - offsets, targets: edges in compressed sparse row layout
+///  - strings: stringCount + 1 offsets into blob, string i is
+///    blob[strings[i] .. strings[i + 1]), UTF-8 without terminator
+namespace Binary {
+
+constexpr quint32 magic = 0x42474e56; // "VNGB"
+constexpr quint32 version = 1;
+constexpr quint32 noString = 0xffffffff;
+
+struct Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 nodeCount;
+    quint32 edgeCount;
+    quint32 stringCount;
+    quint32 blobSize;
+    quint64 nodesOffset;
+    quint64 offsetsOffset;
+    quint64 targetsOffset;
+    quint64 stringsOffset;
+    quint64 blobOffset;
+    quint64 fileSize;
+};
+
+/// NOTE: a and b depend on kind:
+///  Counter:          a - initial value
+///  AdvanceAdd:       a - counter id, b - delta
+///  PredicateCompare: a - counter id, b - value to compare, option - compare option
+///  Literal:          a - value, option - index of its type in Op::Value
+struct NodeRecord
+{
+    quint8 kind;
+    quint8 option;
+    quint16 reserved;
+    qint32 a;
+    qint32 b;
+    quint32 title;
+    quint32 text;
+    quint32 reserved2;
+};
+
+}
+
+
+/// NOTE: throws Error if the graph can't be written
+void saveBinary(const Graph &graph, const QString &filePath);
+
+
+/// NOTE: read-only view of a compiled graph file mapped into memory.
+/// nothing is copied on load, but everything is validated,
+/// so a broken or foreign file throws Error instead
+class BinaryGraph
+{
+public:
+    explicit BinaryGraph(const QString &filePath);
+    BinaryGraph(const BinaryGraph &) = delete;
+    BinaryGraph &operator=(const BinaryGraph &) = delete;
+
+    inline int size() const                 { return int(header_->nodeCount); }
+    inline bool contains(const NodeId id) const { return id >= 0 && id < size() && kind(id) != NodeKind::None; }
+    /// NOTE: id should be below size()
+    inline NodeKind kind(const NodeId id) const { return NodeKind(nodes_[id].kind); }
+    inline const Binary::NodeRecord &record(const NodeId id) const { return nodes_[id]; }
+    Span<NodeId> next(const NodeId id) const;
+    Span<char> utf8(const quint32 string) const;
+    /// NOTE: decoded on every call, empty for ids out of range
+    Text title(const NodeId id) const;
+    Text text(const NodeId id) const;
+
+    /// NOTE: nodes made anew with the same ids and edges, ready for
+    /// freeze() or a Runtime. frames and plain predicates come back
+    /// interned, the latter always ok. throws Error on an Advance
+    /// other than AdvanceAdd, which can't be made from its record
+    Graph load() const;
+private:
+    /// NOTE: checks the header, then sets up sections and checks them
+    void validate(const qint64 size);
+
+    QFile file_;
+    const uchar *data_ = nullptr;
+    const Binary::Header *header_ = nullptr;
+    const Binary::NodeRecord *nodes_ = nullptr;
+    const quint32 *offsets_ = nullptr;
+    const NodeId *targets_ = nullptr;
+    const quint32 *strings_ = nullptr;
+    const char *blob_ = nullptr;
+};
+
+}
+
+#endif // BINARY_H
@@ -0,0 +1,284 @@
+#include "bytecode.h"
+#include "trace.h"
+
+#include <iterator>
+
+
+namespace {
+
+using namespace vn;
+
+const char *const messages[] = {
+    "Missing left part of the equality!",
+    "Missing right part of the equality!",
+    "Too many operands of the equality!",
+    "Compared values are of different types!",
+};
+static_assert(std::size(messages) == int(ErrorCode::TypeMismatch) + 1, "A message per error code");
+
+struct Classify : Visitor
+{
+    void visit(const Node &) override          { ok = false; }
+    void visit(const Counter &) override       { code = Instruction::LoadCounter; }
+    void visit(const Equal &) override         { code = Instruction::Equal; }
+    void visit(const NonEqual &) override      { code = Instruction::NonEqual; }
+    void visit(const Static42 &) override      { code = Instruction::PushInt; arg = 42; }
+    void visit(const Static69 &) override      { code = Instruction::PushInt; arg = 69; }
+    void visit(const Literal &op) override
+    {
+        Scalar value;
+        ok = Scalar::fromValue(op.value_, value);
+        const Instruction ins = constant(value);
+        code = ins.code;
+        arg = ins.arg;
+    }
+    bool ok = true;
+    Instruction::Code code = Instruction::Fail;
+    int arg = 0;
+};
+
+struct Operand
+{
+    Instruction::Code code;
+    int arg;
+    int refs;
+    int slot;
+    bool done;
+};
+
+struct Step
+{
+    NodeId id;
+    int ind;
+};
+
+ErrorCode arityError(const int count)
+{
+    return count == 0 ? ErrorCode::MissingLeft
+         : count == 1 ? ErrorCode::MissingRight
+         : ErrorCode::TooManyOperands;
+}
+
+bool isLeaf(const Operand &operand)
+{
+    return operand.code == Instruction::PushInt
+            || operand.code == Instruction::PushBool
+            || operand.code == Instruction::LoadCounter
+            || operand.code == Instruction::Fail;
+}
+
+}
+
+
+vn::Instruction vn::operand(const Graph &graph, const NodeId id)
+{
+    Classify classify;
+    graph.node(id).accept(classify);
+    if (!classify.ok)
+        throw Error(QString("Node with id %1 can't be an operand").arg(id));
+    if (classify.code == Instruction::LoadCounter)
+        classify.arg = id;
+    return {classify.code, classify.arg};
+}
+
+const char *vn::message(const ErrorCode code)
+{
+    return messages[int(code)];
+}
+
+vn::Op::Value vn::Scalar::toValue() const
+{
+    switch (tag) {
+    case Bool:
+        return payload != 0;
+    case Int:
+        return int(payload);
+    case Error:
+        break;
+    }
+    return Text(message(error()));
+}
+
+bool vn::Scalar::fromValue(const Op::Value &value, Scalar &res)
+{
+    if (const int *i = std::get_if<int>(&value)) {
+        res = ofInt(*i);
+        return true;
+    }
+    if (const bool *b = std::get_if<bool>(&value)) {
+        res = ofBool(*b);
+        return true;
+    }
+    const Text &text = std::get<Text>(value);
+    for (int i = 0; i < int(std::size(messages)); ++i) {
+        if (text == messages[i]) {
+            res = ofError(ErrorCode(i));
+            return true;
+        }
+    }
+    return false;
+}
+
+vn::Instruction vn::constant(const Scalar value)
+{
+    switch (value.tag) {
+    case Scalar::Int:
+        return {Instruction::PushInt, value.payload};
+    case Scalar::Bool:
+        return {Instruction::PushBool, value.payload};
+    case Scalar::Error:
+        break;
+    }
+    return {Instruction::Fail, value.payload};
+}
+
+vn::Scalar vn::missingOperands(const int count)
+{
+    return Scalar::ofError(arityError(count));
+}
+
+vn::Program vn::compile(const Graph &graph, const NodeId root)
+{
+    /// NOTE: first pass classifies operands, counts references
+    /// and rejects cycles
+    QHash<NodeId, Operand> operands;
+    QVector<Step> stack;
+    const auto enter = [&](const NodeId id) {
+        auto it = operands.find(id);
+        if (it != operands.end()) {
+            if (!it.value().done)
+                throw Error(QString("Op with id %1 depends on itself").arg(id));
+            it.value().refs++;
+            return;
+        }
+        const Instruction ins = vn::operand(graph, id);
+        const Operand operand {ins.code, ins.arg, 1, -1, false};
+        operands.insert(id, operand);
+        stack.push_back({id, isLeaf(operand) ? graph.next(id).size() : 0});
+    };
+    enter(root);
+    while (!stack.isEmpty()) {
+        Step &step = stack.last();
+        const QVector<NodeId> next = graph.next(step.id);
+        if (step.ind >= next.size()) {
+            operands[step.id].done = true;
+            stack.pop_back();
+            continue;
+        }
+        enter(next.at(step.ind++));
+    }
+
+    /// NOTE: second pass emits postfix code
+    Program program;
+    int depth = 0;
+    const auto write = [&](const Instruction::Code code, const int arg, const int pop, const int push) {
+        program.code_.push_back({code, arg});
+        depth += push - pop;
+        program.stackSize_ = qMax(program.stackSize_, depth);
+    };
+    const auto open = [&](const NodeId id) {
+        const Operand &operand = operands[id];
+        if (operand.slot >= 0) {
+            write(Instruction::Load, operand.slot, 0, 1);
+            return;
+        }
+        stack.push_back({id, isLeaf(operand) ? graph.next(id).size() : 0});
+    };
+    open(root);
+    while (!stack.isEmpty()) {
+        Step &step = stack.last();
+        const QVector<NodeId> next = graph.next(step.id);
+        if (step.ind < next.size()) {
+            open(next.at(step.ind++));
+            continue;
+        }
+        const NodeId id = step.id;
+        stack.pop_back();
+
+        Operand &operand = operands[id];
+        if (isLeaf(operand)) {
+            write(operand.code, operand.arg, 0, 1);
+        } else if (next.size() == 2) {
+            write(operand.code, 0, 2, 1);
+        } else {
+            if (!next.isEmpty())
+                write(Instruction::Drop, next.size(), next.size(), 0);
+            write(Instruction::Fail, int(arityError(next.size())), 0, 1);
+        }
+        if (operand.refs > 1) {
+            operand.slot = program.slotCount_++;
+            write(Instruction::Store, operand.slot, 0, 0);
+        }
+    }
+    return program;
+}
+
+vn::Op::Value vn::Evaluator::evaluate(const Graph &graph, const NodeId root, const Counters &counters)
+{
+    return value(graph, root, counters).toValue();
+}
+
+vn::Scalar vn::Evaluator::value(const Graph &graph, const NodeId root, const Counters &counters)
+{
+    return run(program(graph, root), counters);
+}
+
+const vn::Program &vn::Evaluator::program(const Graph &graph, const NodeId root)
+{
+    auto it = programs_.find(root);
+    if (it == programs_.end()) {
+        VN_TRACE_COUNT(CacheMisses);
+        it = programs_.insert(root, compile(graph, root));
+    } else {
+        VN_TRACE_COUNT(CacheHits);
+    }
+    return it.value();
+}
+
+void vn::Evaluator::clear()
+{
+    programs_.clear();
+}
+
+vn::Scalar vn::Evaluator::run(const Program &program, const Counters &counters)
+{
+    if (stack_.size() < program.stackSize_)
+        stack_.resize(program.stackSize_);
+    if (slots_.size() < program.slotCount_)
+        slots_.resize(program.slotCount_);
+
+    Scalar *sp = stack_.data();
+    Scalar *slotValues = slots_.data();
+    for (const Instruction &ins : program.code_) {
+        switch (ins.code) {
+        case Instruction::PushInt:
+            *sp++ = Scalar::ofInt(ins.arg);
+            break;
+        case Instruction::PushBool:
+            *sp++ = Scalar::ofBool(ins.arg);
+            break;
+        case Instruction::LoadCounter:
+            *sp++ = Scalar::ofInt(counters.value(ins.arg));
+            break;
+        case Instruction::Equal:
+        case Instruction::NonEqual:
+            sp--;
+            sp[-1] = compare(sp[-1], sp[0], ins.code == Instruction::Equal);
+            break;
+        case Instruction::Store:
+            slotValues[ins.arg] = sp[-1];
+            break;
+        case Instruction::Load:
+            *sp++ = slotValues[ins.arg];
+            break;
+        case Instruction::Drop:
+            sp -= ins.arg;
+            break;
+        case Instruction::Fail:
+            *sp++ = Scalar::ofError(ErrorCode(ins.arg));
+            break;
+        }
+    }
+    Q_ASSERT(sp == stack_.data() + 1);
+    return sp[-1];
+}
@@ -0,0 +1,128 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <QVector>
+#include <QHash>
+
+#include <type_traits>
+
+#include "headers.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: errors evaluation gives, texts are only made by message()
+enum class ErrorCode : quint8 {
+    MissingLeft,
+    MissingRight,
+    TooManyOperands,
+    TypeMismatch,
+};
+const char *message(const ErrorCode code);
+
+
+/// NOTE: value during evaluation. trivially copyable and never allocates,
+/// errors are kept as codes. becomes an Op::Value with the message text
+/// only when handed out of an evaluator
+struct Scalar
+{
+    /// NOTE: in the order of the Op::Value alternatives
+    enum Tag : quint8 {
+        Error,
+        Bool,
+        Int,
+    };
+    Tag tag = Error;
+    qint32 payload = 0;
+
+    static constexpr inline Scalar ofInt(const int value)         { return {Int, value}; }
+    static constexpr inline Scalar ofBool(const bool value)       { return {Bool, value}; }
+    static constexpr inline Scalar ofError(const ErrorCode error) { return {Error, qint32(error)}; }
+    inline bool isError() const       { return tag == Error; }
+    inline ErrorCode error() const    { return ErrorCode(payload); }
+    inline bool operator==(const Scalar &other) const { return tag == other.tag && payload == other.payload; }
+    inline bool operator!=(const Scalar &other) const { return !(*this == other); }
+
+    Op::Value toValue() const;
+    /// NOTE: false for a text which isn't one of the messages
+    static bool fromValue(const Op::Value &value, Scalar &res);
+};
+static_assert(std::is_trivially_copyable<Scalar>::value, "Scalar is copied as is");
+static_assert(sizeof(Scalar) == 8, "Scalar is two words");
+
+
+struct Instruction
+{
+    enum Code : quint8 {
+        PushInt,
+        PushBool,
+        LoadCounter,
+        Equal,
+        NonEqual,
+        /// NOTE: copies top of the stack to slot arg, keeps it on stack
+        Store,
+        Load,
+        Drop,
+        Fail,
+    };
+    Code code;
+    int arg;
+};
+
+
+/// NOTE: Op subgraph flattened to postfix order. operands shared by
+/// several ops are computed once and reused through slots
+struct Program
+{
+    QVector<Instruction> code_;
+    int stackSize_ = 0;
+    int slotCount_ = 0;
+};
+
+
+/// NOTE: Op edges point to operands, Counter operands read counters.
+/// throws Error on cycles or on nodes that can't be operands
+Program compile(const Graph &graph, const NodeId root);
+
+/// NOTE: instruction a single operand node turns into,
+/// arity of Equal/NonEqual is not checked here
+Instruction operand(const Graph &graph, const NodeId id);
+/// NOTE: instruction pushing value, Fail with the error code for errors
+Instruction constant(const Scalar value);
+/// NOTE: value of Equal/NonEqual with count operands instead of two
+Scalar missingOperands(const int count);
+
+inline Scalar compare(const Scalar l, const Scalar r, const bool equal)
+{
+    if (l.isError())
+        return l;
+    if (r.isError())
+        return r;
+    if (l.tag != r.tag)
+        return Scalar::ofError(ErrorCode::TypeMismatch);
+    return Scalar::ofBool((l.payload == r.payload) == equal);
+}
+
+
+/// NOTE: keeps compiled programs per root and the value stack between
+/// evaluations, so after warm up value() and run() don't allocate,
+/// errors included. evaluate() makes the message of an error.
+/// call clear() after the graph changed
+class Evaluator
+{
+public:
+    Evaluator() = default;
+    Op::Value evaluate(const Graph &graph, const NodeId root, const Counters &counters);
+    Scalar value(const Graph &graph, const NodeId root, const Counters &counters);
+    Scalar run(const Program &program, const Counters &counters);
+    const Program &program(const Graph &graph, const NodeId root);
+    void clear();
+private:
+    QHash<NodeId, Program> programs_;
+    QVector<Scalar> stack_;
+    QVector<Scalar> slots_;
+};
+
+}
+
+#endif // BYTECODE_H
@@ -0,0 +1,57 @@
+#include "compiledgraph.h"
+#include "traversal.h"
+
+
+vn::CompiledGraph vn::freeze(const Graph &graph)
+{
+    CompiledGraph res;
+    const int n = graph.nodes_.isEmpty() ? 0 : (graph.nodes_.lastKey() + 1);
+    res.nodes_.fill(nullptr, n);
+    res.kinds_.fill(NodeKind::None, n);
+    res.flows_.fill(Flow::None, n);
+    for (auto it = graph.nodes_.cbegin(); it != graph.nodes_.cend(); ++it) {
+        res.nodes_[it.key()] = it.value();
+        res.kinds_[it.key()] = kindOf(*it.value());
+        res.flows_[it.key()] = flowOf(res.kinds_[it.key()]);
+    }
+
+    int edgeCount = 0;
+    for (const QVector<NodeId> &dsts : graph.connections_)
+        edgeCount += dsts.size();
+
+    res.offsets_.fill(0, n + 1);
+    res.targets_.reserve(edgeCount);
+    for (NodeId id = 0; id < n; ++id) {
+        res.offsets_[id] = res.targets_.size();
+        const auto it = graph.connections_.constFind(id);
+        if (it != graph.connections_.cend())
+            res.targets_.append(it.value());
+    }
+    res.offsets_[n] = res.targets_.size();
+    return res;
+}
+
+const vn::Node &vn::CompiledGraph::node(const NodeId id) const
+{
+    if (contains(id))
+        return *nodes_[id];
+
+    throw Error(QString("Missing node with id %1").arg(id));
+}
+
+vn::Span<vn::NodeId> vn::CompiledGraph::next(const NodeId id) const
+{
+    if (id < 0 || id >= size())
+        return {};
+    const int begin = offsets_[id];
+    return Span<NodeId>(targets_.constData() + begin, offsets_[id + 1] - begin);
+}
+
+void vn::traverse(
+        const CompiledGraph &graph,
+        const NodeId id,
+        Visitor &visitor)
+{
+    Traversal traversal;
+    return traversal.run(graph, id, visitor);
+}
@@ -0,0 +1,66 @@
+#ifndef COMPILEDGRAPH_H
+#define COMPILEDGRAPH_H
+
+#include <QVector>
+
+#include "headers.h"
+#include "utils.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: read-only snapshot of a Graph with edges in
+/// compressed sparse row layout: targets of node id are
+/// targets_[offsets_[id] .. offsets_[id + 1]).
+/// nodes are not owned, so the source Graph should outlive it
+struct CompiledGraph
+{
+    CompiledGraph() = default;
+    const Node &node(const NodeId id) const;
+    Span<NodeId> next(const NodeId id) const;
+    /// NOTE: kinds are taken once on freeze, id should be contained
+    inline NodeKind kind(const NodeId id) const { return kinds_[id]; }
+    inline Flow flow(const NodeId id) const     { return flows_[id]; }
+    inline bool contains(const NodeId id) const { return id >= 0 && id < size() && nodes_[id] != nullptr; }
+    /// NOTE: upper bound of ids, not the number of nodes
+    inline int size() const                     { return nodes_.size(); }
+    inline int edgeCount() const                { return targets_.size(); }
+private:
+    friend CompiledGraph freeze(const Graph &graph);
+    QVector<const Node *> nodes_;
+    QVector<NodeKind> kinds_;
+    QVector<Flow> flows_;
+    QVector<int> offsets_;
+    QVector<NodeId> targets_;
+};
+
+
+CompiledGraph freeze(const Graph &graph);
+void traverse(const CompiledGraph &graph, const NodeId id, Visitor &visitor);
+
+/// NOTE: calls f(next) for every option of node id under counters, in the
+/// order of edges, until it returns false: frames, predicates ok with the
+/// counters and advances, to be applied once taken. returns the number of
+/// flow nodes after id seen so far, blocked ones included, so a frame with
+/// none is an ending and any other node with no options is a dead end
+template <typename F>
+int forEachOption(const CompiledGraph &graph, const NodeId id, const Counters &counters, F f)
+{
+    int flow = 0;
+    for (const NodeId next : graph.next(id)) {
+        const Flow kind = graph.flow(next);
+        if (kind == Flow::None)
+            continue;
+        flow++;
+        if (kind == Flow::Predicate
+                && !static_cast<const Predicate &>(graph.node(next)).isOk(counters))
+            continue;
+        if (!f(next))
+            break;
+    }
+    return flow;
+}
+
+}
+
+#endif // COMPILEDGRAPH_H
@@ -0,0 +1,67 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <type_traits>
+
+#include "headers.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: base for visitors known at compile time. nothing is virtual,
+/// so traversal calls go straight to the derived type and can be inlined.
+/// visit overloads fall back to the closest base kind like in Visitor,
+/// derived types need `using StaticVisitor::visit;` to keep the defaults
+struct StaticVisitor
+{
+    inline void visit(const Node &)       {}
+    inline bool shouldStop() const        { return false; }
+    inline void stepIn(const Node &)      {}
+    inline void stepOut()                 {}
+};
+
+
+/// NOTE: calls visitor with node cast to its kind. for a Visitor it
+/// replaces accept, leaving one virtual call instead of two
+template <typename V>
+void dispatch(const Node &node, const NodeKind kind, V &visitor)
+{
+    if constexpr (std::is_base_of<Visitor, V>::value) {
+        Visitor &base = visitor;
+        switch (kind) {
+        case NodeKind::Frame:            return base.visit(static_cast<const Frame &>(node));
+        case NodeKind::Predicate:        return base.visit(static_cast<const Predicate &>(node));
+        case NodeKind::PredicateCompare: return base.visit(static_cast<const PredicateCompare &>(node));
+        case NodeKind::Counter:          return base.visit(static_cast<const Counter &>(node));
+        case NodeKind::Advance:          return base.visit(static_cast<const Advance &>(node));
+        case NodeKind::AdvanceAdd:       return base.visit(static_cast<const AdvanceAdd &>(node));
+        case NodeKind::Op:               return base.visit(static_cast<const Op &>(node));
+        case NodeKind::Equal:            return base.visit(static_cast<const Equal &>(node));
+        case NodeKind::NonEqual:         return base.visit(static_cast<const NonEqual &>(node));
+        case NodeKind::Static42:         return base.visit(static_cast<const Static42 &>(node));
+        case NodeKind::Static69:         return base.visit(static_cast<const Static69 &>(node));
+        case NodeKind::Literal:          return base.visit(static_cast<const Literal &>(node));
+        case NodeKind::None:             return node.accept(base);
+        }
+    } else {
+        switch (kind) {
+        case NodeKind::Frame:            return visitor.visit(static_cast<const Frame &>(node));
+        case NodeKind::Predicate:        return visitor.visit(static_cast<const Predicate &>(node));
+        case NodeKind::PredicateCompare: return visitor.visit(static_cast<const PredicateCompare &>(node));
+        case NodeKind::Counter:          return visitor.visit(static_cast<const Counter &>(node));
+        case NodeKind::Advance:          return visitor.visit(static_cast<const Advance &>(node));
+        case NodeKind::AdvanceAdd:       return visitor.visit(static_cast<const AdvanceAdd &>(node));
+        case NodeKind::Op:               return visitor.visit(static_cast<const Op &>(node));
+        case NodeKind::Equal:            return visitor.visit(static_cast<const Equal &>(node));
+        case NodeKind::NonEqual:         return visitor.visit(static_cast<const NonEqual &>(node));
+        case NodeKind::Static42:         return visitor.visit(static_cast<const Static42 &>(node));
+        case NodeKind::Static69:         return visitor.visit(static_cast<const Static69 &>(node));
+        case NodeKind::Literal:          return visitor.visit(static_cast<const Literal &>(node));
+        case NodeKind::None:             return visitor.visit(node);
+        }
+    }
+}
+
+}
+
+#endif // DISPATCH_H
@@ -0,0 +1,210 @@
+#include "dot.h"
+
+#include <QSaveFile>
+#include <QVector>
+
+#include <charconv>
+#include <cstring>
+
+
+namespace {
+
+using namespace vn;
+
+class Writer
+{
+public:
+    Writer(QIODevice &device, const int bufferSize) :
+        device_(device),
+        buffer_(qMax(bufferSize, 64), '\0')
+    {}
+
+    void put(const char *data, int size)
+    {
+        while (size > 0) {
+            if (pos_ == buffer_.size())
+                flush();
+            const int n = qMin(size, buffer_.size() - pos_);
+            memcpy(buffer_.data() + pos_, data, size_t(n));
+            pos_ += n;
+            data += n;
+            size -= n;
+        }
+    }
+    inline void put(const char c)
+    {
+        if (pos_ == buffer_.size())
+            flush();
+        buffer_[pos_++] = c;
+    }
+    inline void put(const char *text)
+    {
+        put(text, int(strlen(text)));
+    }
+    void put(const int value)
+    {
+        char digits[16];
+        const auto res = std::to_chars(digits, digits + sizeof(digits), value);
+        put(digits, int(res.ptr - digits));
+    }
+
+    /// NOTE: inside of a quoted string. backslashes are escaped too,
+    /// otherwise dot reads "\l" or "\N" in a text as its own escapes
+    void putEscaped(const QByteArray &utf8)
+    {
+        for (const char c : utf8) {
+            switch (c) {
+            case '"':
+                put("\\\"", 2);
+                break;
+            case '\\':
+                put("\\\\", 2);
+                break;
+            case '\n':
+                put("\\n", 2);
+                break;
+            case '\r':
+                break;
+            default:
+                put(c);
+            }
+        }
+    }
+
+    void flush()
+    {
+        if (pos_ > 0 && device_.write(buffer_.constData(), pos_) != pos_)
+            throw Error(QString("Failed to write dot: %1").arg(device_.errorString()));
+        pos_ = 0;
+    }
+
+private:
+    QIODevice &device_;
+    QByteArray buffer_;
+    int pos_ = 0;
+};
+
+struct Label : Visitor
+{
+    void visit(const Frame &frame) override
+    {
+        title = frame.title();
+        text = frame.text();
+        labeled = true;
+    }
+    void visit(const Predicate &predicate) override
+    {
+        title = predicate.title();
+        text = predicate.text();
+        labeled = true;
+    }
+    Text title;
+    Text text;
+    bool labeled = false;
+};
+
+void writeNode(Writer &writer, const NodeId id, const Node &node)
+{
+    Label label;
+    node.accept(label);
+    writer.put(id);
+    if (label.labeled) {
+        writer.put(" [label=\"");
+        writer.putEscaped(label.title.toUtf8());
+        writer.put(":\\n");
+        writer.putEscaped(label.text.toUtf8());
+        writer.put("\"]");
+    }
+    writer.put(";\n");
+}
+
+void writeEdges(Writer &writer, const Graph &graph, const NodeId id)
+{
+    const auto it = graph.connections_.constFind(id);
+    if (it == graph.connections_.cend())
+        return;
+    for (const NodeId dst : it.value()) {
+        writer.put(id);
+        writer.put("->");
+        writer.put(dst);
+        writer.put(";\n");
+    }
+}
+
+/// NOTE: union-find over ids with path halving
+NodeId root(QVector<NodeId> &parents, NodeId id)
+{
+    while (parents[id] != id) {
+        parents[id] = parents[parents[id]];
+        id = parents[id];
+    }
+    return id;
+}
+
+}
+
+
+void vn::writeDot(const Graph &graph, QIODevice &device, const DotOptions &options)
+{
+    Writer writer(device, options.bufferSize);
+
+    if (!options.components) {
+        writer.put("digraph {\n");
+        for (auto it = graph.nodes_.cbegin(); it != graph.nodes_.cend(); ++it)
+            writeNode(writer, it.key(), *it.value());
+        for (auto it = graph.nodes_.cbegin(); it != graph.nodes_.cend(); ++it)
+            writeEdges(writer, graph, it.key());
+        writer.put("}\n");
+        writer.flush();
+        return;
+    }
+
+    const int n = graph.nodes_.isEmpty() ? 0 : (graph.nodes_.lastKey() + 1);
+    QVector<NodeId> parents(n);
+    for (NodeId id = 0; id < n; ++id)
+        parents[id] = id;
+    for (auto it = graph.connections_.cbegin(); it != graph.connections_.cend(); ++it)
+        for (const NodeId dst : it.value()) {
+            const NodeId a = root(parents, it.key());
+            const NodeId b = root(parents, dst);
+            if (a != b)
+                parents[qMax(a, b)] = qMin(a, b);
+        }
+
+    /// NOTE: ids grouped by component with a counting sort, components
+    /// are numbered in order of their smallest ids
+    QVector<int> begins(n + 1, 0);
+    for (auto it = graph.nodes_.cbegin(); it != graph.nodes_.cend(); ++it)
+        begins[root(parents, it.key()) + 1]++;
+    for (NodeId id = 0; id < n; ++id)
+        begins[id + 1] += begins[id];
+    QVector<NodeId> order(begins[n]);
+    QVector<int> fill = begins;
+    for (auto it = graph.nodes_.cbegin(); it != graph.nodes_.cend(); ++it)
+        order[fill[root(parents, it.key())]++] = it.key();
+
+    int component = 0;
+    for (NodeId r = 0; r < n; ++r) {
+        if (begins[r] == begins[r + 1])
+            continue;
+        writer.put("digraph component_");
+        writer.put(component++);
+        writer.put(" {\n");
+        for (int i = begins[r]; i < begins[r + 1]; ++i)
+            writeNode(writer, order[i], graph.node(order[i]));
+        for (int i = begins[r]; i < begins[r + 1]; ++i)
+            writeEdges(writer, graph, order[i]);
+        writer.put("}\n");
+    }
+    writer.flush();
+}
+
+void vn::saveDot(const Graph &graph, const QString &filePath, const DotOptions &options)
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        throw Error(QString("Failed to open %1 for writing: %2").arg(filePath).arg(file.errorString()));
+    writeDot(graph, file, options);
+    if (!file.commit())
+        throw Error(QString("Failed to save %1: %2").arg(filePath).arg(file.errorString()));
+}
@@ -0,0 +1,30 @@
+#ifndef DOT_H
+#define DOT_H
+
+#include <QIODevice>
+#include <QString>
+
+#include "headers.h"
+
+
+namespace VisualNovelGraph {
+
+struct DotOptions
+{
+    /// NOTE: one digraph per weakly connected component, one after
+    /// another in the same output, `dot -O` renders each of them
+    bool components = false;
+    int bufferSize = 64 * 1024;
+};
+
+
+/// NOTE: writes the whole graph in GraphViz format as it goes, holding
+/// no more than one buffer of output. nodes are named by their NodeIds,
+/// frames and predicates are labeled with "title:\ntext".
+/// throws Error if the device can't be written
+void writeDot(const Graph &graph, QIODevice &device, const DotOptions &options = {});
+void saveDot(const Graph &graph, const QString &filePath, const DotOptions &options = {});
+
+}
+
+#endif // DOT_H
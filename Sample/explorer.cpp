@@ -0,0 +1,392 @@
+#include "explorer.h"
+#include "trace.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+
+#include "compiledgraph.h"
+
+
+namespace {
+
+using namespace vn;
+
+enum Flag : quint8 {
+    Expanded = 1,
+    Ending = 2,
+    DeadEnd = 4,
+    /// NOTE: some successor didn't fit into caps
+    Incomplete = 8,
+};
+
+struct State
+{
+    NodeId node;
+    QVector<int> values;
+    inline bool operator==(const State &other) const
+    {
+        return node == other.node && values == other.values;
+    }
+};
+
+inline uint qHash(const State &state, uint seed = 0)
+{
+    return ::qHash(state.values, seed) ^ (uint(state.node) * 0x9e3779b9u);
+}
+
+struct Task
+{
+    int id;
+    State state;
+};
+
+struct Edge
+{
+    int src;
+    int dst;
+};
+
+constexpr int shardCount = 64;
+
+struct Shard
+{
+    QMutex mutex;
+    QHash<State, int> ids;
+};
+
+/// NOTE: owner takes from the back, thieves from the front
+struct Worker
+{
+    QMutex mutex;
+    std::deque<Task> tasks;
+    QVector<Edge> edges;
+};
+
+class Search
+{
+public:
+    Search(const Graph &graph, const ExploreOptions &options);
+    ExploreReport run(const NodeId start);
+private:
+    int insert(const State &state, bool &isNew);
+    void push(const int worker, Task &&task);
+    bool pop(const int worker, Task &task);
+    bool steal(const int worker, Task &task);
+    void work(const int worker);
+    void expand(const Task &task, const int worker, Counters &counters, Counters &advanced);
+    ExploreReport report() const;
+
+    const CompiledGraph frozen_;
+    const Counters initial_;
+    int threads_ = 1;
+    int capacity_ = 0;
+
+    Shard shards_[shardCount];
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<NodeId> nodes_;
+    std::vector<quint8> flags_;
+    std::atomic<int> next_ {0};
+    /// NOTE: tasks pushed and not expanded yet, queued ones wait in deques
+    std::atomic<int> pending_ {0};
+    std::atomic<int> queued_ {0};
+    std::atomic<bool> truncated_ {false};
+
+    /// NOTE: idle workers sleep on idle_ until a task is queued, all tasks
+    /// are done or one of the workers failed
+    QMutex idleMutex_;
+    QWaitCondition idle_;
+    std::atomic<int> sleeping_ {0};
+    std::atomic<bool> stop_ {false};
+    std::exception_ptr error_;
+};
+
+Search::Search(const Graph &graph, const ExploreOptions &options) :
+    frozen_(freeze(graph)),
+    initial_(graph)
+{
+    threads_ = options.threads > 0 ? options.threads : qMax(1, QThread::idealThreadCount());
+    const qint64 bytesPerState = 96 + qint64(initial_.size()) * sizeof(int) * 2;
+    capacity_ = int(qMin<qint64>(options.maxStates, options.maxBytes / bytesPerState));
+    capacity_ = qMax(capacity_, 1);
+    nodes_.resize(capacity_);
+    flags_.resize(capacity_);
+    for (int i = 0; i < threads_; ++i)
+        workers_.emplace_back(new Worker);
+}
+
+int Search::insert(const State &state, bool &isNew)
+{
+    isNew = false;
+    Shard &shard = shards_[qHash(state) % shardCount];
+    QMutexLocker locker(&shard.mutex);
+    const auto it = shard.ids.constFind(state);
+    if (it != shard.ids.cend())
+        return it.value();
+
+    const int id = next_.fetch_add(1);
+    if (id >= capacity_) {
+        truncated_ = true;
+        return -1;
+    }
+    nodes_[id] = state.node;
+    shard.ids.insert(state, id);
+    isNew = true;
+    return id;
+}
+
+void Search::push(const int worker, Task &&task)
+{
+    pending_++;
+    {
+        Worker &w = *workers_[worker];
+        QMutexLocker locker(&w.mutex);
+        w.tasks.push_back(std::move(task));
+        queued_++;
+    }
+    if (sleeping_ > 0) {
+        QMutexLocker locker(&idleMutex_);
+        idle_.wakeOne();
+    }
+}
+
+bool Search::pop(const int worker, Task &task)
+{
+    Worker &w = *workers_[worker];
+    QMutexLocker locker(&w.mutex);
+    if (w.tasks.empty())
+        return false;
+    task = std::move(w.tasks.back());
+    w.tasks.pop_back();
+    queued_--;
+    return true;
+}
+
+bool Search::steal(const int worker, Task &task)
+{
+    for (int i = 1; i < threads_; ++i) {
+        Worker &w = *workers_[(worker + i) % threads_];
+        QMutexLocker locker(&w.mutex);
+        if (w.tasks.empty())
+            continue;
+        task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+        queued_--;
+        return true;
+    }
+    return false;
+}
+
+void Search::work(const int worker)
+{
+    Counters counters = initial_;
+    Counters advanced = initial_;
+    Task task;
+    while (!stop_) {
+        if (!pop(worker, task) && !steal(worker, task)) {
+            QMutexLocker locker(&idleMutex_);
+            sleeping_++;
+            while (queued_ == 0 && pending_ != 0 && !stop_)
+                idle_.wait(&idleMutex_);
+            sleeping_--;
+            if (pending_ == 0)
+                return;
+            continue;
+        }
+        try {
+            expand(task, worker, counters, advanced);
+        } catch (...) {
+            /// NOTE: the first error wins, the others stop and it is
+            /// rethrown once all of them are joined
+            QMutexLocker locker(&idleMutex_);
+            if (!error_)
+                error_ = std::current_exception();
+            stop_ = true;
+            idle_.wakeAll();
+            return;
+        }
+        if (--pending_ == 0) {
+            QMutexLocker locker(&idleMutex_);
+            idle_.wakeAll();
+        }
+    }
+}
+
+/// NOTE: predicates are checked on counters, advances applied on advanced
+void Search::expand(const Task &task, const int worker, Counters &counters, Counters &advanced)
+{
+    const NodeId node = task.state.node;
+    QVector<Edge> &edges = workers_[worker]->edges;
+
+    quint8 flags = Expanded;
+    int passed = 0;
+    counters.reset(task.state.values);
+    const int flow = forEachOption(frozen_, node, counters, [&](const NodeId next) {
+        passed++;
+        State state {next, task.state.values};
+        if (frozen_.flow(next) == Flow::Advance) {
+            advanced.reset(task.state.values);
+            static_cast<const Advance &>(frozen_.node(next)).redo(advanced);
+            state.values = advanced.values();
+        }
+
+        bool isNew = false;
+        const int id = insert(state, isNew);
+        if (id < 0) {
+            flags |= Incomplete;
+            return true;
+        }
+        edges.append({task.id, id});
+        if (isNew)
+            push(worker, {id, state});
+        return true;
+    });
+
+    if (flow == 0)
+        flags |= frozen_.flow(node) == Flow::Frame ? Ending : DeadEnd;
+    else if (passed == 0)
+        flags |= DeadEnd;
+    flags_[task.id] = flags;
+}
+
+ExploreReport Search::run(const NodeId start)
+{
+    frozen_.node(start);
+    bool isNew = false;
+    const State state {start, initial_.values()};
+    push(0, {insert(state, isNew), state});
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threads_; ++i)
+        threads.emplace_back(&Search::work, this, i);
+    for (std::thread &thread : threads)
+        thread.join();
+    if (error_)
+        std::rethrow_exception(error_);
+    return report();
+}
+
+ExploreReport Search::report() const
+{
+    ExploreReport res;
+    const int n = qMin(next_.load(), capacity_);
+    res.states = n;
+    res.truncated = truncated_;
+
+    /// NOTE: reverse edges in compressed sparse row layout
+    QVector<int> offsets(n + 1, 0);
+    for (const auto &worker : workers_)
+        for (const Edge &edge : worker->edges)
+            offsets[edge.dst + 1]++;
+    for (int i = 0; i < n; ++i)
+        offsets[i + 1] += offsets[i];
+    res.edges = offsets[n];
+    QVector<int> sources(res.edges);
+    QVector<int> fill = offsets;
+    for (const auto &worker : workers_)
+        for (const Edge &edge : worker->edges)
+            sources[fill[edge.dst]++] = edge.src;
+
+    /// NOTE: states reaching an ending, or maybe reaching one
+    /// through states that didn't fit
+    QVector<bool> reaches(n, false);
+    QVector<int> queue;
+    for (int i = 0; i < n; ++i) {
+        if (flags_[i] & (Ending | Incomplete)) {
+            reaches[i] = true;
+            queue.append(i);
+        }
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        const int dst = queue.at(head);
+        for (int i = offsets[dst]; i < offsets[dst + 1]; ++i) {
+            const int src = sources[i];
+            if (!reaches[src]) {
+                reaches[src] = true;
+                queue.append(src);
+            }
+        }
+    }
+
+    /// NOTE: of the states that can't, peel those with no way further
+    /// until none is left. the rest can go round a cycle forever.
+    /// such states only have edges to states that can't either
+    QVector<int> outgoing(n, 0);
+    for (const auto &worker : workers_)
+        for (const Edge &edge : worker->edges)
+            if (!reaches[edge.src])
+                outgoing[edge.src]++;
+    QVector<bool> stops(n, false);
+    queue.clear();
+    for (int i = 0; i < n; ++i) {
+        if (!reaches[i] && outgoing[i] == 0) {
+            stops[i] = true;
+            queue.append(i);
+        }
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        const int dst = queue.at(head);
+        for (int i = offsets[dst]; i < offsets[dst + 1]; ++i) {
+            const int src = sources[i];
+            if (reaches[src] || stops[src])
+                continue;
+            if (--outgoing[src] == 0) {
+                stops[src] = true;
+                queue.append(src);
+            }
+        }
+    }
+
+    QVector<bool> seen(frozen_.size(), false);
+    QSet<NodeId> endings;
+    QSet<NodeId> deadEnds;
+    QSet<NodeId> loops;
+    for (int i = 0; i < n; ++i) {
+        const NodeId node = nodes_[i];
+        seen[node] = true;
+        if (flags_[i] & Ending)
+            endings.insert(node);
+        if ((flags_[i] & DeadEnd) && !(flags_[i] & Incomplete)) {
+            deadEnds.insert(node);
+            res.deadEndStates++;
+        }
+        if (!reaches[i] && !stops[i]) {
+            loops.insert(node);
+            res.loopStates++;
+        }
+    }
+    for (NodeId id = 0; id < frozen_.size(); ++id)
+        if (frozen_.flow(id) == Flow::Frame && !seen[id])
+            res.unreachableFrames.append(id);
+
+    const auto sorted = [](const QSet<NodeId> &set) {
+        QVector<NodeId> res;
+        res.reserve(set.size());
+        for (const NodeId id : set)
+            res.append(id);
+        std::sort(res.begin(), res.end());
+        return res;
+    };
+    res.endings = sorted(endings);
+    res.deadEnds = sorted(deadEnds);
+    res.loops = sorted(loops);
+    return res;
+}
+
+}
+
+
+vn::ExploreReport vn::explore(const Graph &graph, const NodeId start, const ExploreOptions &options)
+{
+    VN_TRACE_SCOPE("explore");
+    Search search(graph, options);
+    return search.run(start);
+}
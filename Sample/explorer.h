@@ -0,0 +1,50 @@
+#ifndef EXPLORER_H
+#define EXPLORER_H
+
+#include <QVector>
+
+#include "headers.h"
+
+
+namespace VisualNovelGraph {
+
+struct ExploreOptions
+{
+    /// NOTE: zero means one per core
+    int threads = 0;
+    int maxStates = 1 << 20;
+    /// NOTE: rough estimate of state storage, not a hard limit
+    qint64 maxBytes = qint64(1) << 30;
+};
+
+
+struct ExploreReport
+{
+    int states = 0;
+    int edges = 0;
+    /// NOTE: hit maxStates or maxBytes, unexplored states are
+    /// assumed to reach an ending
+    bool truncated = false;
+    /// NOTE: distinct nodes, sorted
+    QVector<NodeId> unreachableFrames;
+    QVector<NodeId> endings;
+    QVector<NodeId> deadEnds;
+    QVector<NodeId> loops;
+    int deadEndStates = 0;
+    int loopStates = 0;
+};
+
+
+/// NOTE: enumerates reachable (node, counters) states from start, following
+/// frames, predicates that are ok with the counters and advances applied to
+/// them. Op and Counter nodes are not part of the flow. frames with nowhere
+/// to go are endings; states whose way further is blocked by predicates are
+/// dead ends; states that can't reach any ending but can go round
+/// a cycle forever, or lead to one, are loops.
+/// runs on several threads with work stealing. an error thrown on one of
+/// them, e.g. by an advance, stops the others and is rethrown here
+ExploreReport explore(const Graph &graph, const NodeId start, const ExploreOptions &options = {});
+
+}
+
+#endif // EXPLORER_H
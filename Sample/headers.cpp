@@ -0,0 +1,645 @@
+#include <QtDebug>
+
+#include <algorithm>
+#include <iostream>
+#include "headers.h"
+#include "traversal.h"
+#include "trace.h"
+
+
+vn::Error::Error(const QString &message) :
+    std::runtime_error(message.toStdString()),
+    message(message)
+{}
+
+vn::NodeId vn::Graph::add(Node *node)
+{
+    arena_.adopt(node);
+    return insert(node);
+}
+
+vn::NodeId vn::Graph::insert(Node *node)
+{
+    const NodeId id = nextId_++;
+    nodes_.insert(id, node);
+    if (journaling_)
+        journal_.append({Edit::NodeInserted, id, -1, -1, node});
+    touch(id);
+    notify();
+    return id;
+}
+
+void vn::Graph::connect(const NodeId src, const NodeId dst)
+{
+    if (!nodes_.contains(src))
+        throw Error(QString("Missing node with id %1 as connection source").arg(src));
+    if (!nodes_.contains(dst))
+        throw Error(QString("Missing node with id %1 as connection destination").arg(dst));
+    const auto it = connections_.constFind(src);
+    insertEdge(src, it == connections_.cend() ? 0 : it->size(), dst);
+    notify();
+}
+
+void vn::Graph::disconnect(const NodeId src, const NodeId dst)
+{
+    const int index = edgeIndex(src, dst);
+    if (index < 0)
+        throw Error(QString("Missing connection from %1 to %2").arg(src).arg(dst));
+    eraseEdge(src, index);
+    notify();
+}
+
+void vn::Graph::retarget(const NodeId src, const NodeId dst, const NodeId newDst)
+{
+    const int index = edgeIndex(src, dst);
+    if (index < 0)
+        throw Error(QString("Missing connection from %1 to %2").arg(src).arg(dst));
+    if (!nodes_.contains(newDst))
+        throw Error(QString("Missing node with id %1 as connection destination").arg(newDst));
+    setEdge(src, index, newDst);
+    notify();
+}
+
+void vn::Graph::remove(const NodeId id)
+{
+    const auto it = nodes_.find(id);
+    if (it == nodes_.end())
+        throw Error(QString("Missing node with id %1").arg(id));
+
+    /// NOTE: from the back, so the indices left to erase stay in place
+    for (int i = connections_.value(id).size() - 1; i >= 0; --i)
+        eraseEdge(id, i);
+    const QVector<NodeId> sources = previous(id);
+    for (const NodeId src : sources)
+        eraseEdge(src, connections_.value(src).lastIndexOf(id));
+
+    if (journaling_)
+        journal_.append({Edit::NodeErased, id, -1, -1, it.value()});
+    nodes_.erase(it);
+    touch(id);
+    notify();
+}
+
+bool vn::Graph::contains(const NodeId id) const
+{
+    return nodes_.contains(id);
+}
+
+const vn::Node &vn::Graph::node(const vn::NodeId id) const
+{
+    const Node *node = nodes_.value(id, nullptr);
+    if (node)
+        return *node;
+
+    throw Error(QString("Missing node with id %1").arg(id));
+}
+
+const QVector<vn::NodeId> vn::Graph::next(const vn::NodeId id) const
+{
+    return connections_.value(id, {});
+}
+
+const QVector<vn::NodeId> vn::Graph::previous(const vn::NodeId id) const
+{
+    return previous_.value(id, {});
+}
+
+void vn::Graph::insertEdge(const NodeId src, const int index, const NodeId dst)
+{
+    connections_[src].insert(index, dst);
+    previous_[dst].append(src);
+    if (journaling_)
+        journal_.append({Edit::EdgeInserted, src, index, dst, nullptr});
+    touch(src);
+    touch(dst);
+}
+
+void vn::Graph::eraseEdge(const NodeId src, const int index)
+{
+    const auto dsts = connections_.find(src);
+    Q_ASSERT(dsts != connections_.end() && index >= 0 && index < dsts->size());
+    const NodeId dst = dsts->at(index);
+    dsts->remove(index);
+    if (dsts->isEmpty())
+        connections_.erase(dsts);
+
+    forget(src, dst);
+
+    if (journaling_)
+        journal_.append({Edit::EdgeErased, src, index, dst, nullptr});
+    touch(src);
+    touch(dst);
+}
+
+void vn::Graph::setEdge(const NodeId src, const int index, const NodeId dst)
+{
+    NodeId &slot = connections_[src][index];
+    const NodeId old = slot;
+    slot = dst;
+
+    forget(src, old);
+    previous_[dst].append(src);
+
+    if (journaling_)
+        journal_.append({Edit::EdgeSet, src, index, old, nullptr});
+    touch(src);
+    touch(old);
+    touch(dst);
+}
+
+void vn::Graph::forget(const NodeId src, const NodeId dst)
+{
+    /// NOTE: order of sources doesn't matter, the last one takes the place
+    const auto srcs = previous_.find(dst);
+    Q_ASSERT(srcs != previous_.end());
+    const int at = srcs->lastIndexOf(src);
+    Q_ASSERT(at >= 0);
+    (*srcs)[at] = srcs->last();
+    srcs->removeLast();
+    if (srcs->isEmpty())
+        previous_.erase(srcs);
+}
+
+int vn::Graph::edgeIndex(const NodeId src, const NodeId dst) const
+{
+    const auto it = connections_.constFind(src);
+    return it == connections_.cend() ? -1 : it->indexOf(dst);
+}
+
+void vn::Graph::touch(const NodeId id)
+{
+    if (watcher_ != nullptr || journaling_)
+        touched_.append(id);
+}
+
+void vn::Graph::notify()
+{
+    if (journaling_)
+        return;
+    if (watcher_ != nullptr && !touched_.isEmpty()) {
+        std::sort(touched_.begin(), touched_.end());
+        touched_.erase(std::unique(touched_.begin(), touched_.end()), touched_.end());
+        watcher_->changed(touched_);
+    }
+    touched_.clear();
+}
+
+void vn::Graph::undo(const Edit &edit)
+{
+    switch (edit.kind) {
+    case Edit::NodeInserted:
+        nodes_.remove(edit.src);
+        break;
+    case Edit::NodeErased:
+        nodes_.insert(edit.src, edit.node);
+        break;
+    case Edit::EdgeInserted:
+        eraseEdge(edit.src, edit.index);
+        break;
+    case Edit::EdgeErased:
+        insertEdge(edit.src, edit.index, edit.dst);
+        break;
+    case Edit::EdgeSet:
+        setEdge(edit.src, edit.index, edit.dst);
+        break;
+    }
+}
+
+vn::Graph::Transaction::Transaction(Graph &graph) :
+    graph_(&graph)
+{
+    if (graph.journaling_)
+        throw Error("Graph transactions can't be nested");
+    graph.journaling_ = true;
+}
+
+vn::Graph::Transaction::~Transaction()
+{
+    rollback();
+}
+
+void vn::Graph::Transaction::commit()
+{
+    if (graph_ == nullptr)
+        return;
+    Graph &graph = *graph_;
+    graph_ = nullptr;
+    graph.journaling_ = false;
+    graph.journal_.clear();
+    graph.notify();
+}
+
+void vn::Graph::Transaction::rollback()
+{
+    if (graph_ == nullptr)
+        return;
+    Graph &graph = *graph_;
+    graph_ = nullptr;
+    graph.journaling_ = false;
+    for (int i = graph.journal_.size() - 1; i >= 0; --i)
+        graph.undo(graph.journal_.at(i));
+    graph.journal_.clear();
+    graph.touched_.clear();
+}
+
+void vn::traverse(
+        const Graph &graph,
+        const NodeId id,
+        Visitor &visitor)
+{
+    Traversal traversal;
+    return traversal.run(graph, id, visitor);
+}
+
+void vn::Frame::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Predicate::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Op::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Counter::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Advance::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::PredicateCompare::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::AdvanceAdd::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Visitor::visit(const PredicateCompare &node)
+{
+    return visit(static_cast<const Predicate &>(node));
+}
+
+void vn::Visitor::visit(const AdvanceAdd &node)
+{
+    return visit(static_cast<const Advance &>(node));
+}
+
+vn::NodeKind vn::kindOf(const Node &node)
+{
+    struct Kind : Visitor
+    {
+        void visit(const Node &) override             { kind = NodeKind::None; }
+        void visit(const Frame &) override            { kind = NodeKind::Frame; }
+        void visit(const Predicate &) override        { kind = NodeKind::Predicate; }
+        void visit(const PredicateCompare &) override { kind = NodeKind::PredicateCompare; }
+        void visit(const Counter &) override          { kind = NodeKind::Counter; }
+        void visit(const Advance &) override          { kind = NodeKind::Advance; }
+        void visit(const AdvanceAdd &) override       { kind = NodeKind::AdvanceAdd; }
+        void visit(const Op &) override               { kind = NodeKind::Op; }
+        void visit(const Equal &) override            { kind = NodeKind::Equal; }
+        void visit(const NonEqual &) override         { kind = NodeKind::NonEqual; }
+        void visit(const Static42 &) override         { kind = NodeKind::Static42; }
+        void visit(const Static69 &) override         { kind = NodeKind::Static69; }
+        void visit(const Literal &) override          { kind = NodeKind::Literal; }
+        NodeKind kind = NodeKind::None;
+    } kind;
+    node.accept(kind);
+    return kind.kind;
+}
+
+vn::Flow vn::flowOf(const NodeKind kind)
+{
+    switch (kind) {
+    case NodeKind::Frame:
+        return Flow::Frame;
+    case NodeKind::Predicate:
+    case NodeKind::PredicateCompare:
+        return Flow::Predicate;
+    case NodeKind::Advance:
+    case NodeKind::AdvanceAdd:
+        return Flow::Advance;
+    default:
+        return Flow::None;
+    }
+}
+
+vn::Print::Print(const vn::Node *start) :
+    start_(start)
+{}
+
+void vn::Print::visit(const Frame &frame)
+{
+    shouldStop_ = &frame != start_;
+    qCDebug(lcPrint).noquote()
+            << space(depth_)
+            << "frame"
+            << &frame
+            << frame.title()
+            << frame.text()
+            << frame.speakerId();
+}
+
+void vn::Print::visit(const Predicate &predicate)
+{
+    Q_UNUSED(predicate)
+    shouldStop_ = false;
+    qCDebug(lcPrint).noquote()
+            << space(depth_)
+            << "predicate"
+            << &predicate
+            << predicate.title()
+            << predicate.text()
+            << "satisfied: "
+            << predicate.isOk();
+}
+
+QString vn::Print::space(const int depth)
+{
+    return QString("*").rightJustified(depth * 2);
+}
+
+void vn::ToGraphViz::visit(const Frame &frame)
+{
+    ss_ << ptrToId_.value(&frame, -1)
+        << " [label=\""
+        << frame.title().toStdString()
+        << ":\\n"
+        << frame.text().toStdString()
+        << "\"]\n";
+}
+
+void vn::ToGraphViz::stepIn(const Node &node)
+{
+    const Node *ptr = &node;
+    ptrToId_.insert(ptr, ptrToId_.value(ptr, ptrToId_.size()));
+    stack_.push_back(ptr);
+
+    const NodeId idSrc = ptrToId_.value(parent_, -1);
+    const NodeId idDst = ptrToId_.value(ptr);
+    parent_ = ptr;
+
+    if (idSrc >= 0)
+        ss_ << idSrc << "->" << idDst << ";\n";
+}
+
+void vn::ToGraphViz::stepOut()
+{
+    stack_.pop_back();
+    parent_ = stack_.empty() ? nullptr : stack_.back();
+}
+
+QString vn::ToGraphViz::digraphText() const
+{
+    return QString("digraph {\n%1\n}").arg(QString::fromStdString(ss_.str()));
+}
+void vn::Compute::visit(const Equal &op)
+{
+    opToFoo_.insert(&op, LazyValue([this]{
+        int l;
+        int r;
+        if (!read(values_[0], l))
+            return Value("Missing left part of the equality!");
+        if (!read(values_[1], r))
+            return Value("Missing right part of the equality!");
+
+        values_.pop_back();
+        values_.pop_back();
+        return Value(l == r);
+    }));
+}
+
+void vn::Compute::visit(const NonEqual &op)
+{
+    opToFoo_.insert(&op, LazyValue([]{ return Op::Value(13); }));
+}
+
+void vn::Compute::visit(const Static42 &op)
+{
+    opToFoo_.insert(&op, Value(42));
+}
+
+void vn::Compute::visit(const Static69 &op)
+{
+    opToFoo_.insert(&op, Value(69));
+}
+
+void vn::Compute::visit(const Literal &op)
+{
+    opToFoo_.insert(&op, op.value_);
+}
+
+void vn::Compute::stepIn(const Node &node)
+{
+    stack_.push_back(&node);
+}
+
+void vn::Compute::stepOut()
+{
+    Q_ASSERT(!stack_.isEmpty());
+    const Node *node = stack_.back();
+    stack_.pop_back();
+
+    MaybeLazyValue maybeLazyValue = opToFoo_.value(node);
+    Value *value = std::get_if<Value>(&maybeLazyValue);
+    if (value != nullptr) {
+        VN_TRACE_COUNT(CacheHits);
+        values_.push_front(*value);
+        qCDebug(lcCompute) << "get" << node << "->" << text(*value);
+        return;
+    }
+
+    VN_TRACE_COUNT(CacheMisses);
+    const auto foo = std::get<LazyValue>(maybeLazyValue);
+    const Value res = foo();
+    opToFoo_.insert(node, res);
+    values_.push_front(res);
+    qCDebug(lcCompute) << "compute" << node << "->" << text(res);
+}
+
+QString vn::Compute::text(const Value &value)
+{
+    std::stringstream ss;
+    ss << value;
+    return QString::fromStdString(ss.str());
+}
+
+bool vn::Compute::shouldStop() const
+{
+    return false;
+}
+
+void vn::Static42::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Static69::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Literal::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::Equal::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+void vn::NonEqual::accept(Visitor &visitor) const
+{
+    return visitor.visit(*this);
+}
+
+std::ostream &operator<<(std::ostream &stream, const vn::Op::Value &value)
+{
+    std::visit([&stream](auto &&arg) {
+        using T = std::decay_t<decltype(arg)>;
+        const std::size_t ind = vn::variant_index<vn::Op::Value, T>();
+        stream << vn::Op::names.at(ind);
+        if constexpr (std::is_same_v<T, int>)
+            stream << " " << arg;
+        else if constexpr (std::is_same_v<T, bool>)
+            stream << (arg ? " True" : " False");
+    }, value);
+    return stream;
+}
+
+
+vn::Counters::Counters(const Graph &graph)
+{
+    struct Initial : Visitor
+    {
+        void visit(const Counter &counter) override { value = counter.initialValue(); ok = true; }
+        int value = 0;
+        bool ok = false;
+    };
+
+    slots_.fill(-1, graph.nodes_.isEmpty() ? 0 : (graph.nodes_.lastKey() + 1));
+    for (auto it = graph.nodes_.cbegin(); it != graph.nodes_.cend(); ++it) {
+        Initial initial;
+        it.value()->accept(initial);
+        if (!initial.ok)
+            continue;
+        slots_[it.key()] = values_.size();
+        ids_.append(it.key());
+        values_.append(initial.value);
+    }
+}
+
+void vn::Counters::set(const NodeId id, const int value)
+{
+    const int ind = slot(id);
+    if (ind < 0)
+        throw Error(QString("Missing counter with id %1").arg(id));
+    if (recording_)
+        journal_.append({ind, values_[ind], value});
+    write(ind, value);
+}
+
+void vn::Counters::reset(const QVector<int> &values)
+{
+    Q_ASSERT(values.size() == values_.size());
+    if (watcher_ == nullptr) {
+        values_ = values;
+    } else {
+        for (int slot = 0; slot < values_.size(); ++slot)
+            if (values_[slot] != values[slot])
+                write(slot, values[slot]);
+    }
+    journal_.clear();
+    steps_.clear();
+    step_ = 0;
+}
+
+void vn::Counters::apply(const Advance &advance)
+{
+    journal_.resize(step_ < steps_.size() ? steps_[step_] : journal_.size());
+    steps_.resize(step_);
+    steps_.append(journal_.size());
+    step_++;
+
+    recording_ = true;
+    try {
+        advance.redo(*this);
+    } catch (...) {
+        recording_ = false;
+        throw;
+    }
+    recording_ = false;
+}
+
+bool vn::Counters::undo()
+{
+    if (step_ == 0)
+        return false;
+    step_--;
+    for (int i = stepEnd(step_) - 1; i >= steps_[step_]; --i)
+        write(journal_[i].slot, journal_[i].before);
+    return true;
+}
+
+bool vn::Counters::redo()
+{
+    if (step_ == steps_.size())
+        return false;
+    for (int i = steps_[step_]; i < stepEnd(step_); ++i)
+        write(journal_[i].slot, journal_[i].after);
+    step_++;
+    return true;
+}
+
+void vn::Counters::write(const int slot, const int value)
+{
+    values_[slot] = value;
+    if (watcher_)
+        watcher_->changed(ids_[slot]);
+}
+
+int vn::Counters::stepEnd(const int step) const
+{
+    return (step + 1 < steps_.size()) ? steps_[step + 1] : journal_.size();
+}
+
+void vn::AdvanceAdd::redo(Counters &counters) const
+{
+    counters.set(counterId_, counters.value(counterId_) + delta_);
+}
+
+void vn::AdvanceAdd::undo(Counters &counters) const
+{
+    counters.set(counterId_, counters.value(counterId_) - delta_);
+}
+
+bool vn::PredicateCompare::isOk() const
+{
+    return isOk(Counters());
+}
+
+bool vn::PredicateCompare::isOk(const Counters &counters) const
+{
+    const int counter = counters.value(nodeId_);
+    switch (compareOption_) {
+    case Greater:        return counter >  valueToCompare_;
+    case Less:           return counter <  valueToCompare_;
+    case GreaterOrEqual: return counter >= valueToCompare_;
+    case LessOrEqual:    return counter <= valueToCompare_;
+    case Equal:          return counter == valueToCompare_;
+    case NonEqual:       return counter != valueToCompare_;
+    }
+    throw Error(QString("Unknown predicate compare option: %1").arg(compareOption_));
+}
@@ -2,6 +2,7 @@
 #define HEADERS_H
 
 #include <exception>
+#include <memory>
 #include <sstream>
 #include <iostream>
 
@@ -10,9 +11,12 @@
 #include <QVector>
 #include <QtDebug>
 #include <QMap>
+#include <QHash>
 #include <QSet>
 
 #include "utils.h"
+#include "arena.h"
+#include "stringpool.h"
 
 
 namespace VisualNovelGraph {
@@ -25,6 +29,8 @@ struct Visitor;
 struct Compute;
 struct Counters;
 struct FrameStatic;
+struct PredicateCompare;
+struct AdvanceAdd;
 
 
 struct Node
@@ -48,6 +54,7 @@ struct Predicate : Node
     virtual Text title() const = 0;
     virtual Text text() const = 0;
     virtual bool isOk() const = 0;
+    inline virtual bool isOk(const Counters &) const { return isOk(); }
     void accept(Visitor &visitor) const override;
 };
 
@@ -83,6 +90,17 @@ struct Static69 : Op
 };
 
 
+/// NOTE: constant left by optimize() in place of a folded subtree,
+/// an error is one of the messages compare() and friends give
+struct Literal : Op
+{
+    Literal() = default;
+    inline explicit Literal(const Value &value) : value_(value) {}
+    void accept(Visitor &visitor) const override;
+    Value value_;
+};
+
+
 struct Equal : Op
 {
     void accept(Visitor &visitor) const override;
@@ -100,6 +118,7 @@ struct Counter : Node
     virtual Text title() const = 0;
     virtual Text description() const = 0;
     virtual int initialValue() const = 0;
+    void accept(Visitor &visitor) const override;
 };
 
 
@@ -107,6 +126,7 @@ struct Advance : Node
 {
     virtual void redo(Counters &) const = 0;
     virtual void undo(Counters &) const = 0;
+    void accept(Visitor &visitor) const override;
 };
 
 
@@ -118,17 +138,49 @@ struct Visitor
     inline virtual void visit(const Predicate &node) { return visit(static_cast<const Node &>(node)); }
     inline virtual void visit(const Counter &node)   { return visit(static_cast<const Node &>(node)); }
     inline virtual void visit(const Advance &node)   { return visit(static_cast<const Node &>(node)); }
+    virtual void visit(const PredicateCompare &node);
+    virtual void visit(const AdvanceAdd &node);
     inline virtual void visit(const Op &node)        { return visit(static_cast<const Node &>(node)); }
     inline virtual void visit(const Equal &node)     { return visit(static_cast<const Op &>(node)); }
     inline virtual void visit(const NonEqual &node)  { return visit(static_cast<const Op &>(node)); }
     inline virtual void visit(const Static42 &node)  { return visit(static_cast<const Op &>(node)); }
     inline virtual void visit(const Static69 &node)  { return visit(static_cast<const Op &>(node)); }
+    inline virtual void visit(const Literal &node)   { return visit(static_cast<const Op &>(node)); }
     inline virtual bool shouldStop() const           { return false; }
     inline virtual void stepIn(const Node &)         {}
     inline virtual void stepOut()                    {}
 };
 
 
+enum class NodeKind : quint8 {
+    None,
+    Frame,
+    Predicate,
+    PredicateCompare,
+    Counter,
+    Advance,
+    AdvanceAdd,
+    Op,
+    Equal,
+    NonEqual,
+    Static42,
+    Static69,
+    Literal,
+};
+NodeKind kindOf(const Node &node);
+
+/// NOTE: part a node plays in the flow of a story: frames are shown,
+/// predicates let it through when ok with the counters and advances
+/// change them on the way. counters and ops are not part of it
+enum class Flow : quint8 {
+    None,
+    Frame,
+    Predicate,
+    Advance,
+};
+Flow flowOf(const NodeKind kind);
+
+
 struct Q_PACKED Print : Visitor
 {
     Print(const Node *start);
@@ -167,11 +219,13 @@ struct Compute : Visitor
     void visit(const NonEqual &op) override;
     void visit(const Static42 &op) override;
     void visit(const Static69 &op) override;
+    void visit(const Literal &op) override;
     void stepIn(const Node &node) override;
     void stepOut() override;
     bool shouldStop() const override;
 private:
     using Value = Op::Value;
+    static QString text(const Value &value);
     using LazyValue = std::function<Value()>;
     using MaybeLazyValue = std::variant<LazyValue, Value>;
 
@@ -199,26 +253,111 @@ private:
 
 struct Graph
 {
-    // TODO: personally don't like
+    /// NOTE: notified with every node whose existence or edges changed,
+    /// once per edit or once per committed transaction
+    struct Watcher
+    {
+        virtual ~Watcher() = default;
+        virtual void changed(const QVector<NodeId> &ids) = 0;
+    };
+
+    /// NOTE: edits made on the graph while alive are journaled and
+    /// rolled back unless committed, e.g. when one of them throws.
+    /// the watcher hears of them only on commit. can't be nested
+    class Transaction
+    {
+    public:
+        explicit Transaction(Graph &graph);
+        ~Transaction();
+        Transaction(const Transaction &) = delete;
+        Transaction &operator=(const Transaction &) = delete;
+        void commit();
+        void rollback();
+    private:
+        Graph *graph_;
+    };
+
+    Graph() = default;
+    Graph(const Graph &) = delete;
+    Graph &operator=(const Graph &) = delete;
+    Graph(Graph &&) = default;
+    Graph &operator=(Graph &&) = default;
+
+    /// NOTE: the node is made in the graph's arena and lives as long as the graph
+    template <typename T, typename ...Args>
+    NodeId add(Args &&...args)
+    {
+        return insert(arena_.make<T>(std::forward<Args>(args)...));
+    }
+    /// NOTE: takes ownership, the node is deleted together with the graph
     NodeId add(Node *node);
     // TODO: personally don't like
     void connect(const NodeId src, const NodeId dst);
+    /// NOTE: removes the first of the edges from src to dst
     void disconnect(const NodeId src, const NodeId dst);
-
+    /// NOTE: points the first edge from src to dst at newDst,
+    /// keeping its place among the choices of src
+    void retarget(const NodeId src, const NodeId dst, const NodeId newDst);
+    /// NOTE: drops the node with all of its edges. the node itself stays
+    /// in the arena until the graph is gone, its id is not given out again
+    void remove(const NodeId id);
+
+    bool contains(const NodeId id) const;
     const Node &node(const NodeId id) const;
     const QVector<NodeId> next(const NodeId id) const;
+    /// NOTE: sources of the edges leading to id, one per edge, in no particular order
+    const QVector<NodeId> previous(const NodeId id) const;
+    /// NOTE: shared by interned nodes, stays in place when the graph is moved
+    inline StringPool &strings()             { return *strings_; }
+    inline const StringPool &strings() const { return *strings_; }
+    /// NOTE: read only, edit through the methods above
+    /// so the reverse edges stay in sync
     QMap<NodeId, Node *> nodes_;
     QMap<NodeId, QVector<NodeId>> connections_;
+    Watcher *watcher_ = nullptr;
+private:
+    struct Edit
+    {
+        enum Kind {
+            NodeInserted,
+            NodeErased,
+            EdgeInserted,
+            EdgeErased,
+            EdgeSet,
+        } kind;
+        NodeId src;
+        int index;
+        NodeId dst;
+        Node *node;
+    };
+    NodeId insert(Node *node);
+    void insertEdge(const NodeId src, const int index, const NodeId dst);
+    void eraseEdge(const NodeId src, const int index);
+    void setEdge(const NodeId src, const int index, const NodeId dst);
+    /// NOTE: drops one src from the sources of dst
+    void forget(const NodeId src, const NodeId dst);
+    int edgeIndex(const NodeId src, const NodeId dst) const;
+    void touch(const NodeId id);
+    void notify();
+    void undo(const Edit &edit);
+
+    Arena arena_;
+    std::unique_ptr<StringPool> strings_ = std::make_unique<StringPool>();
+    QHash<NodeId, QVector<NodeId>> previous_;
+    NodeId nextId_ = 0;
+    bool journaling_ = false;
+    QVector<Edit> journal_;
+    QVector<NodeId> touched_;
 };
 
 
 void traverse(const Graph &graph, const NodeId id, Visitor &visitor);
-void traverse_(const Graph &graph, const NodeId id, Visitor &visitor, QSet<NodeId> &traversed);
 
 
 struct FrameStatic : Frame
 {
     FrameStatic() = default;
+    inline FrameStatic(const Text &title, const Text &text) : title_(title), text_(text) {}
     inline Text title() const override          { return title_; }
     inline Text text() const override           { return text_; }
     inline SpeakerId speakerId() const override { return -1; }
@@ -230,6 +369,7 @@ struct FrameStatic : Frame
 struct PredicateStatic : Predicate
 {
     PredicateStatic() = default;
+    inline PredicateStatic(const Text &title, const Text &text) : title_(title), text_(text) {}
     inline Text title() const override { return title_; }
     inline Text text() const override  { return text_; }
     inline bool isOk() const override  { return true; }
@@ -238,10 +378,114 @@ struct PredicateStatic : Predicate
 };
 
 
+/// NOTE: frame and predicate with text in a StringPool,
+/// decoded every time it's asked for
+struct FrameInterned : Frame
+{
+    inline FrameInterned(StringPool &pool, const Text &title, const Text &text) :
+        pool_(&pool), title_(pool.add(title)), text_(pool.add(text)) {}
+    inline Text title() const override          { return pool_->text(title_); }
+    inline Text text() const override           { return pool_->text(text_); }
+    inline SpeakerId speakerId() const override { return -1; }
+    const StringPool *pool_;
+    StringPool::Id title_;
+    StringPool::Id text_;
+};
+
+
+struct PredicateInterned : Predicate
+{
+    inline PredicateInterned(StringPool &pool, const Text &title, const Text &text) :
+        pool_(&pool), title_(pool.add(title)), text_(pool.add(text)) {}
+    inline Text title() const override { return pool_->text(title_); }
+    inline Text text() const override  { return pool_->text(text_); }
+    inline bool isOk() const override  { return true; }
+    const StringPool *pool_;
+    StringPool::Id title_;
+    StringPool::Id text_;
+};
+
+
 struct Counters
 {
-    // TODO: change to match a real one
-    int value(const NodeId) const { return 42; }
+    struct Watcher
+    {
+        virtual ~Watcher() = default;
+        virtual void changed(const NodeId id) = 0;
+    };
+
+    Counters() = default;
+    /// NOTE: one slot per Counter node, starting with its initial value
+    explicit Counters(const Graph &graph);
+    /// NOTE: ids which aren't counters read as zero
+    inline int value(const NodeId id) const
+    {
+        const int ind = slot(id);
+        return ind < 0 ? 0 : values_[ind];
+    }
+    inline int slot(const NodeId id) const { return (id >= 0 && id < slots_.size()) ? slots_[id] : -1; }
+    inline int size() const                { return values_.size(); }
+    inline const QVector<int> &values() const { return values_; }
+    /// NOTE: replaces all values at once and forgets the journal,
+    /// watcher hears of every value that differs
+    void reset(const QVector<int> &values);
+    /// NOTE: changes made outside of apply are not journaled
+    void set(const NodeId id, const int value);
+
+    /// NOTE: redoes advance and journals what it changed as one step,
+    /// dropping steps undone before. undo/redo then replay the journal
+    /// without calling the advance again
+    void apply(const Advance &advance);
+    bool undo();
+    bool redo();
+    inline int step() const      { return step_; }
+    inline int stepCount() const { return steps_.size(); }
+
+    /// NOTE: notified on every change of a value
+    Watcher *watcher_ = nullptr;
+private:
+    struct Delta
+    {
+        int slot;
+        int before;
+        int after;
+    };
+    void write(const int slot, const int value);
+    int stepEnd(const int step) const;
+
+    QVector<NodeId> ids_;
+    QVector<int> slots_;
+    QVector<int> values_;
+    QVector<Delta> journal_;
+    QVector<int> steps_;
+    int step_ = 0;
+    bool recording_ = false;
+};
+
+
+struct CounterStatic : Counter
+{
+    CounterStatic() = default;
+    inline CounterStatic(const Text &title, const Text &description, const int initialValue) :
+        title_(title), description_(description), initialValue_(initialValue) {}
+    inline Text title() const override       { return title_; }
+    inline Text description() const override { return description_; }
+    inline int initialValue() const override { return initialValue_; }
+    Text title_;
+    Text description_;
+    int initialValue_ = 0;
+};
+
+
+struct AdvanceAdd : Advance
+{
+    AdvanceAdd() = default;
+    inline AdvanceAdd(const NodeId counterId, const int delta) : counterId_(counterId), delta_(delta) {}
+    void redo(Counters &counters) const override;
+    void undo(Counters &counters) const override;
+    void accept(Visitor &visitor) const override;
+    NodeId counterId_ = -1;
+    int delta_ = 0;
 };
 
 //template <typename T>
@@ -263,25 +507,28 @@ struct Counters
 //}
 
 
-//struct PredicateCompare : Predicate
-//{
-//    PredicateCompare() = default;
-//    inline Text title() const override { return title_; }
-//    inline Text text() const override  { return text_; }
-//    bool isOk(const Counters &) const override;
-//    Text title_;
-//    Text text_;
-//    NodeId nodeId_ = -1;
-//    int valueToCompare_ = 0;
-//    enum {
-//        Greater,
-//        Less,
-//        GreaterOrEqual,
-//        LessOrEqual,
-//        Equal,
-//        NonEqual,
-//    } compareOption_ = Greater;
-//};
+struct PredicateCompare : Predicate
+{
+    PredicateCompare() = default;
+    inline Text title() const override { return title_; }
+    inline Text text() const override  { return text_; }
+    /// NOTE: without counters at hand compares with default ones
+    bool isOk() const override;
+    bool isOk(const Counters &counters) const override;
+    void accept(Visitor &visitor) const override;
+    Text title_;
+    Text text_;
+    NodeId nodeId_ = -1;
+    int valueToCompare_ = 0;
+    enum CompareOption {
+        Greater,
+        Less,
+        GreaterOrEqual,
+        LessOrEqual,
+        Equal,
+        NonEqual,
+    } compareOption_ = Greater;
+};
 
 }
 
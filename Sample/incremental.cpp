@@ -0,0 +1,184 @@
+#include "incremental.h"
+
+#include <QSet>
+
+
+vn::Incremental::Incremental(const Graph &graph, Counters &counters) :
+    graph_(graph),
+    counters_(counters)
+{
+    counters_.watcher_ = this;
+}
+
+vn::Incremental::~Incremental()
+{
+    if (counters_.watcher_ == this)
+        counters_.watcher_ = nullptr;
+}
+
+vn::Op::Value vn::Incremental::evaluate(const NodeId op)
+{
+    return value(op).toValue();
+}
+
+vn::Scalar vn::Incremental::value(const NodeId op)
+{
+    if (!entries_.contains(op))
+        track(op);
+
+    const Entry &entry = entries_[op];
+    if (!entry.dirty) {
+        hits_++;
+        return entry.value;
+    }
+    recompute(op);
+    return entries_[op].value;
+}
+
+void vn::Incremental::changed(const NodeId counter)
+{
+    const auto readers = readers_.constFind(counter);
+    if (readers == readers_.cend())
+        return;
+
+    stack_.clear();
+    for (const NodeId id : readers.value())
+        stack_.append(id);
+    while (!stack_.isEmpty()) {
+        Entry &entry = entries_[stack_.takeLast()];
+        if (entry.dirty)
+            continue;
+        entry.dirty = true;
+        for (const NodeId id : entry.users)
+            stack_.append(id);
+    }
+}
+
+void vn::Incremental::clear()
+{
+    entries_.clear();
+    readers_.clear();
+}
+
+/// NOTE: new entries are built aside and merged once all of them are,
+/// so a cycle or a bad operand leaves nothing half tracked
+void vn::Incremental::track(const NodeId root)
+{
+    struct Step
+    {
+        NodeId id;
+        int ind;
+    };
+    struct Use
+    {
+        NodeId id;
+        NodeId user;
+    };
+    QVector<Step> stack;
+    QSet<NodeId> path;
+    QHash<NodeId, Entry> tracked;
+    /// NOTE: new users of entries tracked before
+    QVector<Use> uses;
+    const auto enter = [&](const NodeId id) {
+        const Instruction ins = operand(graph_, id);
+        const bool isLeaf = ins.code == Instruction::PushInt
+                || ins.code == Instruction::PushBool
+                || ins.code == Instruction::LoadCounter
+                || ins.code == Instruction::Fail;
+        Entry entry {ins.code, ins.arg, true, Scalar(), {}, {}};
+        if (!isLeaf)
+            entry.operands = graph_.next(id);
+        tracked.insert(id, entry);
+        stack.push_back({id, 0});
+        path.insert(id);
+    };
+
+    enter(root);
+    while (!stack.isEmpty()) {
+        Step &step = stack.last();
+        const QVector<NodeId> &operands = tracked[step.id].operands;
+        if (step.ind >= operands.size()) {
+            path.remove(step.id);
+            stack.pop_back();
+            continue;
+        }
+        const NodeId user = step.id;
+        const NodeId id = operands.at(step.ind++);
+        if (path.contains(id))
+            throw Error(QString("Op with id %1 depends on itself").arg(id));
+        if (entries_.contains(id)) {
+            uses.append({id, user});
+            continue;
+        }
+        if (!tracked.contains(id))
+            enter(id);
+        QVector<NodeId> &users = tracked[id].users;
+        if (!users.contains(user))
+            users.append(user);
+    }
+
+    for (auto it = tracked.cbegin(); it != tracked.cend(); ++it) {
+        if (it->code == Instruction::LoadCounter)
+            readers_[it->arg].append(it.key());
+        entries_.insert(it.key(), it.value());
+    }
+    for (const Use &use : uses) {
+        QVector<NodeId> &users = entries_[use.id].users;
+        if (!users.contains(use.user))
+            users.append(use.user);
+    }
+}
+
+void vn::Incremental::recompute(const NodeId root)
+{
+    stack_.clear();
+    stack_.append(root);
+    while (!stack_.isEmpty()) {
+        Entry &entry = entries_[stack_.last()];
+        if (!entry.dirty) {
+            stack_.pop_back();
+            continue;
+        }
+
+        bool ready = true;
+        for (const NodeId id : entry.operands) {
+            if (entries_[id].dirty) {
+                stack_.push_back(id);
+                ready = false;
+            }
+        }
+        if (!ready)
+            continue;
+
+        switch (entry.code) {
+        case Instruction::PushInt:
+            entry.value = Scalar::ofInt(entry.arg);
+            break;
+        case Instruction::PushBool:
+            entry.value = Scalar::ofBool(entry.arg);
+            break;
+        case Instruction::Fail:
+            entry.value = Scalar::ofError(ErrorCode(entry.arg));
+            break;
+        case Instruction::LoadCounter:
+            entry.value = Scalar::ofInt(counters_.value(entry.arg));
+            break;
+        case Instruction::Equal:
+        case Instruction::NonEqual:
+            if (entry.operands.size() != 2) {
+                entry.value = missingOperands(entry.operands.size());
+                break;
+            }
+            entry.value = compare(
+                        entries_[entry.operands.at(0)].value,
+                        entries_[entry.operands.at(1)].value,
+                        entry.code == Instruction::Equal);
+            break;
+        default:
+            Q_ASSERT(false);
+        }
+        entry.dirty = false;
+        misses_++;
+        stack_.pop_back();
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <QVector>
+#include <QHash>
+
+#include "headers.h"
+#include "bytecode.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: keeps values of Op nodes between reads. every tracked op knows
+/// the ops using it and every counter knows the ops reading it, so a
+/// counter change only marks those ops and their users dirty.
+/// dirty ops are recomputed on the next read. watches the counters
+/// while alive, so there should be one per Counters
+class Incremental : public Counters::Watcher
+{
+public:
+    Incremental(const Graph &graph, Counters &counters);
+    ~Incremental() override;
+    /// NOTE: value doesn't allocate once op is tracked,
+    /// evaluate makes the message of an error
+    Scalar value(const NodeId op);
+    Op::Value evaluate(const NodeId op);
+    void changed(const NodeId counter) override;
+    /// NOTE: forget everything, e.g. after the graph changed
+    void clear();
+    inline int hits() const   { return hits_; }
+    inline int misses() const { return misses_; }
+private:
+    struct Entry
+    {
+        Instruction::Code code;
+        int arg;
+        bool dirty;
+        Scalar value;
+        QVector<NodeId> operands;
+        QVector<NodeId> users;
+    };
+    void track(const NodeId root);
+    void recompute(const NodeId root);
+
+    const Graph &graph_;
+    Counters &counters_;
+    QHash<NodeId, Entry> entries_;
+    QHash<NodeId, QVector<NodeId>> readers_;
+    /// NOTE: kept between calls, so nothing is allocated once ops are tracked
+    QVector<NodeId> stack_;
+    int hits_ = 0;
+    int misses_ = 0;
+};
+
+}
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,291 @@
+#include "optimizer.h"
+#include "bytecode.h"
+
+#include <QHash>
+#include <QSet>
+
+#include <algorithm>
+
+
+namespace {
+
+using namespace vn;
+
+struct Key
+{
+    Instruction::Code code;
+    int arg;
+    NodeId l;
+    NodeId r;
+    inline bool operator==(const Key &other) const
+    {
+        return code == other.code && arg == other.arg && l == other.l && r == other.r;
+    }
+};
+
+inline uint qHash(const Key &key, uint seed = 0)
+{
+    return seed
+            ^ (uint(key.code) * 0x9e3779b9u)
+            ^ (uint(key.arg) * 0x85ebca6bu)
+            ^ (uint(key.l) * 0xc2b2ae35u)
+            ^ uint(key.r);
+}
+
+/// NOTE: what is known of an op once its operands are
+struct Info
+{
+    Instruction::Code code;
+    int arg;
+    bool done;
+    bool constant;
+    Scalar value;
+    /// NOTE: node users should point at, -1 until a constant is needed
+    NodeId canon;
+};
+
+struct Step
+{
+    NodeId id;
+    int ind;
+};
+
+bool isOp(const NodeKind kind)
+{
+    return kind >= NodeKind::Op && kind <= NodeKind::Literal;
+}
+
+bool isLeaf(const Instruction::Code code)
+{
+    return code == Instruction::PushInt
+            || code == Instruction::PushBool
+            || code == Instruction::LoadCounter
+            || code == Instruction::Fail;
+}
+
+/// NOTE: some value of the type of an op which isn't constant.
+/// errors only depend on types, so compare() over these tells them
+Scalar sample(const Info &info)
+{
+    return info.code == Instruction::LoadCounter ? Scalar::ofInt(0) : Scalar::ofBool(false);
+}
+
+class Optimizer
+{
+public:
+    explicit Optimizer(Graph &graph);
+    OptimizeReport run(const QVector<NodeId> &roots);
+private:
+    QVector<NodeId> external() const;
+    void sort(const QVector<NodeId> &starts);
+    void fold(const NodeId id);
+    NodeId materialize(const NodeId id);
+    void removeUnused(const QVector<NodeId> &used);
+
+    Graph &graph_;
+    QHash<NodeId, Info> infos_;
+    QVector<NodeId> order_;
+    QHash<Key, NodeId> table_;
+    OptimizeReport report_;
+};
+
+Optimizer::Optimizer(Graph &graph) :
+    graph_(graph)
+{}
+
+OptimizeReport Optimizer::run(const QVector<NodeId> &roots)
+{
+    const QVector<NodeId> users = external();
+    sort(roots + users);
+    for (const NodeId id : order_)
+        fold(id);
+
+    for (const NodeId root : roots)
+        report_.roots.append(materialize(root));
+    QVector<NodeId> used = report_.roots;
+    for (const NodeId id : users) {
+        const NodeId canon = materialize(id);
+        used.append(canon);
+        if (canon == id)
+            continue;
+        /// NOTE: sources are all non-Op nodes, an edge each
+        const QVector<NodeId> sources = graph_.previous(id);
+        for (const NodeId src : sources)
+            graph_.retarget(src, id, canon);
+    }
+    removeUnused(used);
+    return report_;
+}
+
+/// NOTE: ops with edges from non-Op nodes, sorted
+QVector<NodeId> Optimizer::external() const
+{
+    QSet<NodeId> res;
+    for (auto it = graph_.nodes_.cbegin(); it != graph_.nodes_.cend(); ++it) {
+        if (isOp(kindOf(*it.value())))
+            continue;
+        for (const NodeId dst : graph_.next(it.key()))
+            if (isOp(kindOf(graph_.node(dst))))
+                res.insert(dst);
+    }
+    QVector<NodeId> sorted(res.cbegin(), res.cend());
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
+/// NOTE: operands before users, like compile()
+void Optimizer::sort(const QVector<NodeId> &starts)
+{
+    QVector<Step> stack;
+    const auto enter = [&](const NodeId id) {
+        const auto it = infos_.constFind(id);
+        if (it != infos_.cend()) {
+            if (!it.value().done)
+                throw Error(QString("Op with id %1 depends on itself").arg(id));
+            return;
+        }
+        const Instruction ins = vn::operand(graph_, id);
+        infos_.insert(id, {ins.code, ins.arg, false, false, Scalar(), -1});
+        stack.push_back({id, isLeaf(ins.code) ? graph_.next(id).size() : 0});
+    };
+    for (const NodeId start : starts) {
+        enter(start);
+        while (!stack.isEmpty()) {
+            Step &step = stack.last();
+            const QVector<NodeId> next = graph_.next(step.id);
+            if (step.ind >= next.size()) {
+                infos_[step.id].done = true;
+                order_.append(step.id);
+                stack.pop_back();
+                continue;
+            }
+            enter(next.at(step.ind++));
+        }
+    }
+}
+
+void Optimizer::fold(const NodeId id)
+{
+    Info &info = infos_[id];
+    switch (info.code) {
+    case Instruction::PushInt:
+        info.constant = true;
+        info.value = Scalar::ofInt(info.arg);
+        return;
+    case Instruction::PushBool:
+        info.constant = true;
+        info.value = Scalar::ofBool(info.arg);
+        return;
+    case Instruction::Fail:
+        info.constant = true;
+        info.value = Scalar::ofError(ErrorCode(info.arg));
+        return;
+    case Instruction::LoadCounter:
+        info.canon = id;
+        return;
+    default:
+        break;
+    }
+
+    const QVector<NodeId> next = graph_.next(id);
+    if (next.size() != 2) {
+        info.constant = true;
+        info.value = missingOperands(next.size());
+        report_.folded++;
+        report_.errors++;
+        return;
+    }
+    const Info &l = infos_[next.at(0)];
+    const Info &r = infos_[next.at(1)];
+    const Scalar value = compare(
+                l.constant ? l.value : sample(l),
+                r.constant ? r.value : sample(r),
+                info.code == Instruction::Equal);
+    const bool isError = value.isError();
+    if ((l.constant && r.constant) || isError) {
+        info.constant = true;
+        info.value = value;
+        report_.folded++;
+        report_.errors += isError;
+        return;
+    }
+
+    const Instruction::Code code = info.code;
+    const NodeId a = materialize(next.at(0));
+    const NodeId b = materialize(next.at(1));
+    const Key key {code, 0, qMin(a, b), qMax(a, b)};
+    const auto it = table_.constFind(key);
+    if (it != table_.cend()) {
+        infos_[id].canon = it.value();
+        report_.shared++;
+        return;
+    }
+    table_.insert(key, id);
+    infos_[id].canon = id;
+    /// NOTE: with both edges to the same node the first
+    /// retarget takes the first edge, the second one the other
+    if (next.at(0) != a)
+        graph_.retarget(id, next.at(0), a);
+    if (next.at(1) != b)
+        graph_.retarget(id, next.at(1), b);
+}
+
+/// NOTE: a constant becomes the first leaf or Literal with its value,
+/// a new Literal if there's none yet
+NodeId Optimizer::materialize(const NodeId id)
+{
+    Info &info = infos_[id];
+    if (info.canon >= 0)
+        return info.canon;
+
+    Q_ASSERT(info.constant);
+    const Instruction ins = constant(info.value);
+    const Key key {ins.code, ins.arg, -1, -1};
+    const auto it = table_.constFind(key);
+    if (it != table_.cend()) {
+        if (isLeaf(info.code))
+            report_.shared++;
+        info.canon = it.value();
+        return info.canon;
+    }
+    NodeId canon = id;
+    if (!isLeaf(info.code)) {
+        canon = graph_.add<Literal>(info.value.toValue());
+        report_.literals++;
+    }
+    table_.insert(key, canon);
+    infos_[id].canon = canon;
+    return canon;
+}
+
+void Optimizer::removeUnused(const QVector<NodeId> &used)
+{
+    QSet<NodeId> live;
+    QVector<NodeId> stack = used;
+    while (!stack.isEmpty()) {
+        const NodeId id = stack.takeLast();
+        if (live.contains(id))
+            continue;
+        live.insert(id);
+        const Instruction ins = vn::operand(graph_, id);
+        if (!isLeaf(ins.code))
+            stack.append(graph_.next(id));
+    }
+
+    QVector<NodeId> unused;
+    for (auto it = graph_.nodes_.cbegin(); it != graph_.nodes_.cend(); ++it)
+        if (!live.contains(it.key()) && isOp(kindOf(*it.value())))
+            unused.append(it.key());
+    for (const NodeId id : unused)
+        graph_.remove(id);
+    report_.removed = unused.size();
+}
+
+}
+
+
+vn::OptimizeReport vn::optimize(Graph &graph, const QVector<NodeId> &roots)
+{
+    Optimizer optimizer(graph);
+    return optimizer.run(roots);
+}
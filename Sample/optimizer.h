@@ -0,0 +1,40 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <QVector>
+
+#include "headers.h"
+
+
+namespace VisualNovelGraph {
+
+struct OptimizeReport
+{
+    /// NOTE: ids the roots ended up with, in the order they were given
+    QVector<NodeId> roots;
+    /// NOTE: Equal/NonEqual ops whose value is known, replaced by a Literal
+    int folded = 0;
+    /// NOTE: of the folded ones, those always giving an error
+    int errors = 0;
+    /// NOTE: ops replaced by one of the same kind over the same operands
+    int shared = 0;
+    int literals = 0;
+    int removed = 0;
+};
+
+
+/// NOTE: rewrites Op subgraphs in place. ops used are those reachable
+/// from roots and from edges of non-Op nodes, the rest is removed:
+///  - ops over constants are folded to a Literal, errors included
+///  - ops of the same kind over the same operands are merged,
+///    operands of Equal/NonEqual are taken in either order
+///  - ops left unused after that are removed as well
+/// ids of roots may change, see the report. edits go through the graph,
+/// wrap the call into a Graph::Transaction to be able to undo them.
+/// throws Error on cycles or on nodes that can't be operands,
+/// before anything is changed
+OptimizeReport optimize(Graph &graph, const QVector<NodeId> &roots);
+
+}
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,186 @@
+#include "runtime.h"
+
+#include <QThread>
+
+
+vn::Runtime::Runtime(Graph &&graph, const NodeId start) :
+    graph_(std::move(graph)),
+    frozen_(freeze(graph_)),
+    initial_(graph_),
+    start_(start)
+{
+    frozen_.node(start_);
+}
+
+vn::SaveState vn::Runtime::begin() const
+{
+    SaveState session;
+    session.node = start_;
+    session.counters = initial_.values();
+    return session;
+}
+
+bool vn::Runtime::isValid(const SaveState &session) const
+{
+    return frozen_.contains(session.node) && session.counters.size() == initial_.size();
+}
+
+template <typename F>
+void vn::Runtime::options(const SaveState &session, Counters &scratch, F f) const
+{
+    if (!isValid(session))
+        return;
+    scratch.reset(session.counters);
+    forEachOption(frozen_, session.node, scratch, f);
+}
+
+int vn::Runtime::optionCount(const SaveState &session, Counters &scratch) const
+{
+    int count = 0;
+    options(session, scratch, [&](const NodeId) {
+        count++;
+        return true;
+    });
+    return count;
+}
+
+bool vn::Runtime::choose(SaveState &session, const int option, Counters &scratch) const
+{
+    NodeId target = -1;
+    int ind = 0;
+    options(session, scratch, [&](const NodeId next) {
+        if (ind++ != option)
+            return true;
+        target = next;
+        return false;
+    });
+    if (target < 0)
+        return false;
+
+    /// NOTE: scratch still holds the counters of session
+    if (frozen_.flow(target) == Flow::Advance) {
+        static_cast<const Advance &>(frozen_.node(target)).redo(scratch);
+        session.counters = scratch.values();
+    }
+    session.node = target;
+    session.choices.append(option);
+    return true;
+}
+
+qint64 vn::Runtime::bytes(const SaveState &session)
+{
+    return qint64(sizeof(SaveState))
+            + qint64(session.counters.capacity()) * qint64(sizeof(int))
+            + qint64(session.choices.capacity()) * qint64(sizeof(int));
+}
+
+vn::Scheduler::Scheduler(const Runtime &runtime, const int threads, const int batchSize) :
+    runtime_(runtime),
+    batchSize_(qMax(1, batchSize))
+{
+    const int n = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+    scratch_.assign(n, runtime_.counters());
+    for (int i = 1; i < n; ++i)
+        threads_.emplace_back(&Scheduler::loop, this, i);
+}
+
+vn::Scheduler::~Scheduler()
+{
+    {
+        QMutexLocker locker(&mutex_);
+        stop_ = true;
+        wake_.wakeAll();
+    }
+    for (std::thread &thread : threads_)
+        thread.join();
+}
+
+void vn::Scheduler::advance(QVector<SaveState> &sessions, const Step &step)
+{
+    if (sessions.isEmpty())
+        return;
+    {
+        QMutexLocker locker(&mutex_);
+        sessions_ = sessions.data();
+        count_ = sessions.size();
+        step_ = &step;
+        next_ = 0;
+        busy_ = int(threads_.size());
+        generation_++;
+        wake_.wakeAll();
+    }
+    work(0);
+
+    std::exception_ptr error;
+    {
+        QMutexLocker locker(&mutex_);
+        while (busy_ > 0)
+            done_.wait(&mutex_);
+        sessions_ = nullptr;
+        step_ = nullptr;
+        std::swap(error, error_);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+int vn::Scheduler::advance(QVector<SaveState> &sessions, const QVector<int> &options)
+{
+    if (options.size() != sessions.size())
+        throw Error(QString("Expected %1 options, one per session, got %2")
+                    .arg(sessions.size()).arg(options.size()));
+
+    /// NOTE: a count per worker, summed once all are done
+    std::vector<int> moved(threads(), 0);
+    advance(sessions, [&](SaveState &session, const int index, Counters &scratch, const int worker) {
+        const int option = options.at(index);
+        if (option >= 0 && runtime_.choose(session, option, scratch))
+            moved[worker]++;
+    });
+    int res = 0;
+    for (const int count : moved)
+        res += count;
+    return res;
+}
+
+void vn::Scheduler::loop(const int worker)
+{
+    quint64 seen = 0;
+    for (;;) {
+        {
+            QMutexLocker locker(&mutex_);
+            while (generation_ == seen && !stop_)
+                wake_.wait(&mutex_);
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+        work(worker);
+
+        QMutexLocker locker(&mutex_);
+        if (--busy_ == 0)
+            done_.wakeAll();
+    }
+}
+
+void vn::Scheduler::work(const int worker)
+{
+    Counters &scratch = scratch_[worker];
+    try {
+        for (;;) {
+            const int begin = next_.fetch_add(batchSize_);
+            if (begin >= count_)
+                return;
+            const int end = qMin(begin + batchSize_, count_);
+            for (int i = begin; i < end; ++i)
+                (*step_)(sessions_[i], i, scratch, worker);
+        }
+    } catch (...) {
+        /// NOTE: no more batches are handed out, advance() rethrows
+        /// the first error once all workers are done
+        QMutexLocker locker(&mutex_);
+        if (!error_)
+            error_ = std::current_exception();
+        next_ = count_;
+    }
+}
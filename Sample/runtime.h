@@ -0,0 +1,117 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "headers.h"
+#include "compiledgraph.h"
+#include "savestate.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: one story played by many sessions at once. the graph is taken
+/// over and never changed again, so every method is const and can be
+/// called from any thread. a session is a SaveState: node, counters by
+/// slot and options picked so far, nothing else. options of a node are
+/// its frames, predicates ok with the counters and advances, in the order
+/// of edges. taking an advance applies it to the counters
+class Runtime
+{
+public:
+    Runtime(Graph &&graph, const NodeId start);
+    Runtime(const Runtime &) = delete;
+    Runtime &operator=(const Runtime &) = delete;
+
+    inline const Graph &graph() const      { return graph_; }
+    inline NodeId start() const             { return start_; }
+    /// NOTE: counters with initial values, a copy per thread
+    /// serves as scratch for the methods below
+    inline const Counters &counters() const { return initial_; }
+
+    /// NOTE: a new session at the start. its counters are shared
+    /// with the runtime until they change
+    SaveState begin() const;
+    int optionCount(const SaveState &session, Counters &scratch) const;
+    /// NOTE: false and session as is if there's no such option
+    bool choose(SaveState &session, const int option, Counters &scratch) const;
+    /// NOTE: a session with nowhere to go
+    inline bool isFinished(const SaveState &session, Counters &scratch) const { return optionCount(session, scratch) == 0; }
+
+    /// NOTE: heap and inline bytes of a session, counters shared
+    /// with other sessions are counted in full
+    static qint64 bytes(const SaveState &session);
+
+private:
+    bool isValid(const SaveState &session) const;
+    /// NOTE: calls f(next) for every option of session until it returns false
+    template <typename F>
+    void options(const SaveState &session, Counters &scratch, F f) const;
+
+    Graph graph_;
+    CompiledGraph frozen_;
+    Counters initial_;
+    NodeId start_;
+};
+
+
+/// NOTE: advances sessions of one runtime on a thread per core. the
+/// calling thread takes part, the others wait for work between calls.
+/// sessions are handed out in batches of contiguous ones, so each one
+/// is touched by a single thread
+class Scheduler
+{
+public:
+    /// NOTE: called on a worker thread for each session with its index
+    /// and the worker's own scratch counters
+    using Step = std::function<void(SaveState &session, const int index, Counters &scratch, const int worker)>;
+
+    /// NOTE: zero threads means one per core
+    explicit Scheduler(const Runtime &runtime, const int threads = 0, const int batchSize = 256);
+    ~Scheduler();
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    inline int threads() const { return int(scratch_.size()); }
+    /// NOTE: calls step once for every session, returns when all are done.
+    /// the first error thrown by step stops handing out sessions and is
+    /// rethrown here, sessions stepped before keep their changes
+    void advance(QVector<SaveState> &sessions, const Step &step);
+    /// NOTE: takes options[i] in session i, negative ones are skipped.
+    /// returns how many sessions moved
+    int advance(QVector<SaveState> &sessions, const QVector<int> &options);
+
+private:
+    void loop(const int worker);
+    void work(const int worker);
+
+    const Runtime &runtime_;
+    const int batchSize_;
+    std::vector<Counters> scratch_;
+    std::vector<std::thread> threads_;
+
+    QMutex mutex_;
+    QWaitCondition wake_;
+    QWaitCondition done_;
+    quint64 generation_ = 0;
+    int busy_ = 0;
+    bool stop_ = false;
+    std::exception_ptr error_;
+
+    SaveState *sessions_ = nullptr;
+    int count_ = 0;
+    const Step *step_ = nullptr;
+    std::atomic<int> next_ {0};
+};
+
+}
+
+#endif // RUNTIME_H
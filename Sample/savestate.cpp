@@ -0,0 +1,175 @@
+#include "savestate.h"
+
+#include <limits>
+
+
+namespace {
+
+const quint32 magic = 0x53534e56; // "VNSS"
+const quint8 version = 1;
+
+void writeVarint(QByteArray &res, const qint64 value)
+{
+    /// NOTE: zigzag, so small negative values stay short
+    quint64 v = (quint64(value) << 1) ^ quint64(value >> 63);
+    while (v >= 0x80) {
+        res.append(char(v | 0x80));
+        v >>= 7;
+    }
+    res.append(char(v));
+}
+
+bool readVarint(const char *&pos, const char *end, qint64 &value)
+{
+    quint64 v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos == end)
+            return false;
+        const quint8 byte = quint8(*pos++);
+        v |= quint64(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            value = qint64(v >> 1) ^ -qint64(v & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readInt(const char *&pos, const char *end, int &value)
+{
+    qint64 v = 0;
+    if (!readVarint(pos, end, v) || v < std::numeric_limits<int>::min() || v > std::numeric_limits<int>::max())
+        return false;
+    value = int(v);
+    return true;
+}
+
+bool readInts(const char *&pos, const char *end, QVector<int> &values)
+{
+    int count = 0;
+    /// NOTE: every value takes at least a byte
+    if (!readInt(pos, end, count) || count < 0 || count > end - pos)
+        return false;
+    values.resize(count);
+    for (int &value : values)
+        if (!readInt(pos, end, value))
+            return false;
+    return true;
+}
+
+}
+
+
+QByteArray vn::saveState(const SaveState &state)
+{
+    QByteArray res;
+    res.reserve(16 + state.counters.size() + state.choices.size());
+    for (int i = 0; i < 4; ++i)
+        res.append(char(magic >> (8 * i)));
+    res.append(char(version));
+    writeVarint(res, state.node);
+    writeVarint(res, state.counters.size());
+    for (const int value : state.counters)
+        writeVarint(res, value);
+    writeVarint(res, state.choices.size());
+    for (const int choice : state.choices)
+        writeVarint(res, choice);
+    return res;
+}
+
+bool vn::loadState(const QByteArray &blob, SaveState &state)
+{
+    const char *pos = blob.constData();
+    const char *end = pos + blob.size();
+    if (blob.size() < 5)
+        return false;
+    quint32 m = 0;
+    for (int i = 0; i < 4; ++i)
+        m |= quint32(quint8(pos[i])) << (8 * i);
+    if (m != magic || quint8(pos[4]) != version)
+        return false;
+    pos += 5;
+
+    SaveState res;
+    if (!readInt(pos, end, res.node)
+            || !readInts(pos, end, res.counters)
+            || !readInts(pos, end, res.choices)
+            || pos != end)
+        return false;
+    state = res;
+    return true;
+}
+
+vn::StateRing::StateRing(const int steps, const int changes) :
+    steps_(qMax(steps, 1)),
+    changes_(qMax(changes, 1))
+{}
+
+void vn::StateRing::reset(const SaveState &state)
+{
+    firstStep_ = endStep_ = 0;
+    firstChange_ = endChange_ = 0;
+    current_ = state;
+}
+
+void vn::StateRing::push(const SaveState &state)
+{
+    const int n = current_.choices.size();
+    /// NOTE: only the last choice is compared, a whole prefix
+    /// would make every push as slow as the playthrough is long
+    if (state.counters.size() != current_.counters.size()
+            || state.choices.size() < n
+            || (n > 0 && state.choices.at(n - 1) != current_.choices.at(n - 1)))
+        return reset(state);
+
+    if (depth() == steps_.size())
+        dropOldest();
+    steps_[int(endStep_ % steps_.size())] = {current_.node, n, endChange_};
+    endStep_++;
+
+    for (int slot = 0; slot < state.counters.size(); ++slot) {
+        int &value = current_.counters[slot];
+        if (value == state.counters.at(slot))
+            continue;
+        /// NOTE: the oldest steps may have changed nothing,
+        /// drop them until there's room
+        while (endChange_ - firstChange_ == changes_.size()) {
+            /// NOTE: one step changing more than the ring holds
+            if (depth() == 1)
+                return reset(state);
+            dropOldest();
+        }
+        changes_[int(endChange_ % changes_.size())] = {slot, value};
+        endChange_++;
+        value = state.counters.at(slot);
+    }
+    current_.node = state.node;
+    for (int i = n; i < state.choices.size(); ++i)
+        current_.choices.append(state.choices.at(i));
+}
+
+bool vn::StateRing::rewind(const int steps)
+{
+    if (steps < 0 || steps > depth())
+        return false;
+    for (int i = 0; i < steps; ++i) {
+        endStep_--;
+        const Step &step = steps_.at(int(endStep_ % steps_.size()));
+        while (endChange_ > step.changesBegin) {
+            endChange_--;
+            const Change &change = changes_.at(int(endChange_ % changes_.size()));
+            current_.counters[change.slot] = change.value;
+        }
+        current_.node = step.node;
+        current_.choices.resize(step.choices);
+    }
+    return true;
+}
+
+void vn::StateRing::dropOldest()
+{
+    firstStep_++;
+    firstChange_ = firstStep_ == endStep_
+            ? endChange_
+            : steps_.at(int(firstStep_ % steps_.size())).changesBegin;
+}
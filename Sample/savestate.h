@@ -0,0 +1,75 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <QByteArray>
+#include <QVector>
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: where the player is: current node, counter values by slot
+/// (see Counters::values) and the option picked on every step
+struct SaveState
+{
+    int node = -1;
+    QVector<int> counters;
+    QVector<int> choices;
+};
+
+/// NOTE: blob is a magic, a version and then varints, so small
+/// counters and option numbers take a byte each.
+/// loadState returns false and leaves state as is on a broken blob
+QByteArray saveState(const SaveState &state);
+bool loadState(const QByteArray &blob, SaveState &state);
+
+
+/// NOTE: recent states for rewinding. only the current state is kept
+/// whole, each step back is stored as what it changed: node, length of
+/// choices and old values of changed counters. both steps and changes
+/// live in fixed rings, the oldest steps are dropped when either is full.
+/// kept C++11 and free of the rest of the graph, the Reader uses it too
+class StateRing
+{
+public:
+    explicit StateRing(const int steps = 4096, const int changes = 64 * 1024);
+
+    /// NOTE: forgets every step
+    void reset(const SaveState &state);
+    /// NOTE: state should extend current choices and have as many counters,
+    /// otherwise the ring is reset to it. call after every choice
+    void push(const SaveState &state);
+    /// NOTE: false if there are fewer steps to go back
+    bool rewind(const int steps = 1);
+
+    inline const SaveState &current() const { return current_; }
+    inline int depth() const                { return int(endStep_ - firstStep_); }
+
+private:
+    struct Step
+    {
+        int node;
+        int choices;
+        qint64 changesBegin;
+    };
+    struct Change
+    {
+        int slot;
+        int value;
+    };
+    void dropOldest();
+
+    QVector<Step> steps_;
+    QVector<Change> changes_;
+    qint64 firstStep_ = 0;
+    qint64 endStep_ = 0;
+    qint64 firstChange_ = 0;
+    qint64 endChange_ = 0;
+    SaveState current_;
+};
+
+}
+
+
+namespace vn = VisualNovelGraph;
+
+#endif // SAVESTATE_H
@@ -0,0 +1,242 @@
+#include "simulator.h"
+#include "trace.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <random>
+#include <thread>
+
+#include "compiledgraph.h"
+
+
+namespace {
+
+using namespace vn;
+
+constexpr qint64 batchSize = 1024;
+
+/// NOTE: histograms by node id, merged once all walks are done
+struct Worker
+{
+    QVector<qint64> visits;
+    QVector<qint64> endings;
+    QVector<qint64> deadEnds;
+    QVector<qint64> lengths;
+    qint64 cut = 0;
+    /// NOTE: options of the current node and running sums of their weights
+    QVector<NodeId> options;
+    QVector<double> sums;
+};
+
+class Simulation
+{
+public:
+    Simulation(const Graph &graph, const SimulateOptions &options);
+    SimulateReport run(const NodeId start);
+private:
+    void work(const int worker);
+    void walk(Worker &w, std::mt19937_64 &rng, Counters &counters) const;
+    SimulateReport report() const;
+
+    const CompiledGraph frozen_;
+    const Counters initial_;
+    /// NOTE: by node id, empty for uniform choices
+    QVector<double> weights_;
+    int threads_ = 1;
+    qint64 walks_ = 0;
+    int maxSteps_ = 0;
+    quint64 seed_ = 0;
+    NodeId start_ = -1;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<qint64> next_ {0};
+    /// NOTE: first error of any worker, rethrown once all are joined
+    QMutex errorMutex_;
+    std::exception_ptr error_;
+    std::atomic<bool> failed_ {false};
+};
+
+Simulation::Simulation(const Graph &graph, const SimulateOptions &options) :
+    frozen_(freeze(graph)),
+    initial_(graph)
+{
+    if (!options.weights.isEmpty()) {
+        weights_.fill(1, frozen_.size());
+        for (auto it = options.weights.cbegin(); it != options.weights.cend(); ++it) {
+            if (!(it.value() >= 0))
+                throw Error(QString("Option with id %1 has a negative weight").arg(it.key()));
+            if (frozen_.contains(it.key()))
+                weights_[it.key()] = it.value();
+        }
+    }
+
+    threads_ = options.threads > 0 ? options.threads : qMax(1, QThread::idealThreadCount());
+    walks_ = qMax<qint64>(0, options.walks);
+    maxSteps_ = qMax(0, options.maxSteps);
+    seed_ = options.seed;
+    for (int i = 0; i < threads_; ++i) {
+        workers_.emplace_back(new Worker);
+        Worker &w = *workers_.back();
+        w.visits.fill(0, frozen_.size());
+        w.endings.fill(0, frozen_.size());
+        w.deadEnds.fill(0, frozen_.size());
+        w.lengths.fill(0, maxSteps_ + 1);
+    }
+}
+
+void Simulation::work(const int worker)
+{
+    Worker &w = *workers_[worker];
+    Counters counters = initial_;
+    std::mt19937_64 rng;
+    try {
+        while (!failed_) {
+            const qint64 batch = next_.fetch_add(1);
+            const qint64 begin = batch * batchSize;
+            if (begin >= walks_)
+                return;
+            rng.seed(seed_ + quint64(batch) * 0x9e3779b97f4a7c15ull);
+            const qint64 end = qMin(begin + batchSize, walks_);
+            for (qint64 i = begin; i < end; ++i)
+                walk(w, rng, counters);
+        }
+    } catch (...) {
+        QMutexLocker locker(&errorMutex_);
+        if (!error_)
+            error_ = std::current_exception();
+        failed_ = true;
+    }
+}
+
+void Simulation::walk(Worker &w, std::mt19937_64 &rng, Counters &counters) const
+{
+    counters.reset(initial_.values());
+    NodeId node = start_;
+    w.visits[node]++;
+    int steps = 0;
+    for (;;) {
+        w.options.clear();
+        w.sums.clear();
+        double total = 0;
+        const int flow = forEachOption(frozen_, node, counters, [&](const NodeId next) {
+            if (!weights_.isEmpty()) {
+                const double weight = weights_[next];
+                if (weight <= 0)
+                    return true;
+                total += weight;
+                w.sums.append(total);
+            }
+            w.options.append(next);
+            return true;
+        });
+
+        if (w.options.isEmpty()) {
+            if (flow == 0 && frozen_.flow(node) == Flow::Frame)
+                w.endings[node]++;
+            else
+                w.deadEnds[node]++;
+            break;
+        }
+        if (steps == maxSteps_) {
+            w.cut++;
+            break;
+        }
+
+        int pick = 0;
+        if (weights_.isEmpty()) {
+            pick = std::uniform_int_distribution<int>(0, w.options.size() - 1)(rng);
+        } else {
+            const double at = std::uniform_real_distribution<double>(0, total)(rng);
+            pick = int(std::upper_bound(w.sums.cbegin(), w.sums.cend(), at) - w.sums.cbegin());
+            pick = qMin(pick, w.options.size() - 1);
+        }
+        node = w.options.at(pick);
+        if (frozen_.flow(node) == Flow::Advance)
+            static_cast<const Advance &>(frozen_.node(node)).redo(counters);
+        w.visits[node]++;
+        steps++;
+    }
+    w.lengths[steps]++;
+}
+
+SimulateReport Simulation::run(const NodeId start)
+{
+    frozen_.node(start);
+    start_ = start;
+
+    /// NOTE: the calling thread is the first worker
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threads_; ++i)
+        threads.emplace_back(&Simulation::work, this, i);
+    work(0);
+    for (std::thread &thread : threads)
+        thread.join();
+    if (error_)
+        std::rethrow_exception(error_);
+    return report();
+}
+
+SimulateReport Simulation::report() const
+{
+    SimulateReport res;
+    res.walks = walks_;
+    res.lengths.fill(0, maxSteps_ + 1);
+    QVector<qint64> visits(frozen_.size(), 0);
+    QVector<qint64> endings(frozen_.size(), 0);
+    QVector<qint64> deadEnds(frozen_.size(), 0);
+    for (const auto &worker : workers_) {
+        res.cut += worker->cut;
+        for (int i = 0; i < res.lengths.size(); ++i)
+            res.lengths[i] += worker->lengths.at(i);
+        for (NodeId id = 0; id < frozen_.size(); ++id) {
+            visits[id] += worker->visits.at(id);
+            endings[id] += worker->endings.at(id);
+            deadEnds[id] += worker->deadEnds.at(id);
+        }
+    }
+    for (NodeId id = 0; id < frozen_.size(); ++id) {
+        if (visits.at(id) > 0 && frozen_.flow(id) == Flow::Frame)
+            res.visits.insert(id, visits.at(id));
+        if (endings.at(id) > 0)
+            res.endings.insert(id, endings.at(id));
+        if (deadEnds.at(id) > 0)
+            res.deadEnds.insert(id, deadEnds.at(id));
+    }
+    while (!res.lengths.isEmpty() && res.lengths.last() == 0)
+        res.lengths.removeLast();
+    return res;
+}
+
+}
+
+
+int vn::SimulateReport::percentile(const double p) const
+{
+    qint64 total = 0;
+    for (const qint64 count : lengths)
+        total += count;
+    if (total == 0)
+        return -1;
+    const qint64 target = qMax<qint64>(1, qint64(std::ceil(qBound(0.0, p, 1.0) * total)));
+    qint64 seen = 0;
+    for (int i = 0; i < lengths.size(); ++i) {
+        seen += lengths.at(i);
+        if (seen >= target)
+            return i;
+    }
+    return lengths.size() - 1;
+}
+
+vn::SimulateReport vn::simulate(const Graph &graph, const NodeId start, const SimulateOptions &options)
+{
+    VN_TRACE_SCOPE("simulate");
+    Simulation simulation(graph, options);
+    return simulation.run(start);
+}
@@ -0,0 +1,58 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <QHash>
+#include <QVector>
+
+#include "headers.h"
+
+
+namespace VisualNovelGraph {
+
+struct SimulateOptions
+{
+    /// NOTE: zero means one per core
+    int threads = 0;
+    qint64 walks = 1000 * 1000;
+    /// NOTE: longer walks are cut, a loop would never end
+    int maxSteps = 10 * 1000;
+    quint64 seed = 42;
+    /// NOTE: weight of an option by the id of its node, missing ones
+    /// weigh 1. empty means uniform choices
+    QHash<NodeId, double> weights;
+};
+
+
+struct SimulateReport
+{
+    qint64 walks = 0;
+    /// NOTE: walks that hit maxSteps
+    qint64 cut = 0;
+    /// NOTE: visits of frames over all walks by id, unvisited ones left out
+    QHash<NodeId, qint64> visits;
+    /// NOTE: walks ended at frames with nowhere to go
+    QHash<NodeId, qint64> endings;
+    /// NOTE: walks stuck at nodes whose options are all blocked
+    /// by predicates or weigh zero
+    QHash<NodeId, qint64> deadEnds;
+    /// NOTE: walks by number of steps taken, cut ones included
+    QVector<qint64> lengths;
+
+    /// NOTE: least length not exceeded by a share p of walks,
+    /// -1 if there are none
+    int percentile(const double p) const;
+};
+
+
+/// NOTE: random walks from start, following the flow the same way as
+/// explore(): frames, predicates that are ok with the counters and
+/// advances applied to them. each step picks one option uniformly or by
+/// weights. walks are handed out in batches to a thread per core, each
+/// batch with its own seed, so reports don't depend on the thread count.
+/// throws Error on a missing start or negative weights, errors thrown
+/// while walking, e.g. by an advance, are rethrown once all threads stop
+SimulateReport simulate(const Graph &graph, const NodeId start, const SimulateOptions &options = {});
+
+}
+
+#endif // SIMULATOR_H
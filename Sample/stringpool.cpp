@@ -0,0 +1,78 @@
+#include "stringpool.h"
+
+#include <cstring>
+
+
+const vn::StringPool::Id vn::StringPool::none;
+
+vn::StringPool::StringPool() :
+    offsets_(1, 0),
+    table_(16, none)
+{}
+
+vn::StringPool::Id vn::StringPool::add(const char *data, const int size)
+{
+    /// NOTE: table is kept at most half full
+    if (2 * (count() + 1) > table_.size())
+        rehash(2 * table_.size());
+
+    const int mask = table_.size() - 1;
+    for (int i = int(hash(data, size)) & mask;; i = (i + 1) & mask) {
+        const Id id = table_.at(i);
+        if (id == none) {
+            const Id res = Id(count());
+            blob_.append(data, size);
+            offsets_.append(quint32(blob_.size()));
+            table_[i] = res;
+            return res;
+        }
+        if (this->size(id) == size && memcmp(this->data(id), data, size_t(size)) == 0)
+            return id;
+    }
+}
+
+vn::StringPool::Id vn::StringPool::add(const QString &text)
+{
+    return text.isNull() ? none : add(text.toUtf8());
+}
+
+QString vn::StringPool::text(const Id id) const
+{
+    return id == none ? QString() : QString::fromUtf8(data(id), size(id));
+}
+
+qint64 vn::StringPool::capacity() const
+{
+    return qint64(blob_.capacity())
+            + qint64(offsets_.capacity()) * qint64(sizeof(quint32))
+            + qint64(table_.capacity()) * qint64(sizeof(Id));
+}
+
+void vn::StringPool::squeeze()
+{
+    blob_.squeeze();
+    offsets_.squeeze();
+}
+
+quint32 vn::StringPool::hash(const char *data, const int size)
+{
+    /// NOTE: FNV-1a
+    quint32 res = 2166136261u;
+    for (int i = 0; i < size; ++i) {
+        res ^= quint8(data[i]);
+        res *= 16777619u;
+    }
+    return res;
+}
+
+void vn::StringPool::rehash(const int tableSize)
+{
+    table_.fill(none, tableSize);
+    const int mask = tableSize - 1;
+    for (Id id = 0; id < Id(count()); ++id) {
+        int i = int(hash(data(id), size(id))) & mask;
+        while (table_.at(i) != none)
+            i = (i + 1) & mask;
+        table_[i] = id;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: deduplicated UTF-8 strings in one buffer, referenced by 32-bit ids.
+/// string i is blob()[offsets()[i] .. offsets()[i + 1]), ids are never
+/// reused or invalidated. QString is only made on text(), so keep ids
+/// and decode at the point of showing.
+/// kept C++11 and free of the rest of the graph, the Reader uses it too
+class StringPool
+{
+public:
+    using Id = quint32;
+    static const Id none = 0xffffffff;
+
+    StringPool();
+    Id add(const char *data, const int size);
+    inline Id add(const QByteArray &utf8) { return add(utf8.constData(), utf8.size()); }
+    /// NOTE: null text gives none, empty text is a string
+    Id add(const QString &text);
+
+    /// NOTE: none gives null
+    QString text(const Id id) const;
+    inline const char *data(const Id id) const { return blob_.constData() + offsets_.at(int(id)); }
+    inline int size(const Id id) const         { return int(offsets_.at(int(id) + 1) - offsets_.at(int(id))); }
+    inline int count() const                   { return offsets_.size() - 1; }
+
+    inline const QByteArray &blob() const        { return blob_; }
+    inline const QVector<quint32> &offsets() const { return offsets_; }
+    /// NOTE: bytes held, buffer, offsets and the lookup table
+    qint64 capacity() const;
+    void squeeze();
+
+private:
+    static quint32 hash(const char *data, const int size);
+    void rehash(const int tableSize);
+
+    QByteArray blob_;
+    QVector<quint32> offsets_;
+    /// NOTE: open addressing with linear probing, none marks empty slots
+    QVector<Id> table_;
+};
+
+}
+
+
+namespace vn = VisualNovelGraph;
+
+#endif // STRINGPOOL_H
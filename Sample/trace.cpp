@@ -0,0 +1,194 @@
+#include "trace.h"
+#include "headers.h"
+
+#include <QMutex>
+#include <QSaveFile>
+#include <QVector>
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+
+namespace VisualNovelGraph {
+
+Q_LOGGING_CATEGORY(lcPrint, "vn.print")
+Q_LOGGING_CATEGORY(lcCompute, "vn.compute")
+
+}
+
+
+namespace {
+
+using namespace vn;
+
+constexpr int maxEvents = 1 << 20;
+
+const char *const metricNames[Trace::MetricCount] = {
+    "steps",
+    "visits",
+    "cacheHits",
+    "cacheMisses",
+    "allocations",
+};
+
+struct Event
+{
+    const char *name;
+    qint64 begin;
+    qint64 duration;
+    int thread;
+    quint64 counters[Trace::MetricCount];
+};
+
+struct Events
+{
+    QMutex mutex;
+    QVector<Event> events;
+    int dropped = 0;
+};
+
+Events &events()
+{
+    static Events res;
+    return res;
+}
+
+qint64 now()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int threadIndex()
+{
+    static std::atomic<int> next {0};
+    static thread_local const int res = next++;
+    return res;
+}
+
+}
+
+
+void vn::Trace::setEnabled(const bool enabled)
+{
+    /// NOTE: start of the clock is taken before anything is measured
+    now();
+    enabled_.store(enabled);
+}
+
+void vn::Trace::clear()
+{
+    Events &e = events();
+    QMutexLocker lock(&e.mutex);
+    e.events.clear();
+    e.dropped = 0;
+}
+
+int vn::Trace::eventCount()
+{
+    Events &e = events();
+    QMutexLocker lock(&e.mutex);
+    return e.events.size();
+}
+
+int vn::Trace::droppedCount()
+{
+    Events &e = events();
+    QMutexLocker lock(&e.mutex);
+    return e.dropped;
+}
+
+void vn::Trace::writeChromeTrace(QIODevice &device)
+{
+    Events &e = events();
+    QMutexLocker lock(&e.mutex);
+
+    QByteArray res;
+    res.reserve(256 + e.events.size() * 192);
+    res.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (int i = 0; i < e.events.size(); ++i) {
+        const Event &event = e.events.at(i);
+        if (i > 0)
+            res.append(',');
+        /// NOTE: trace times are microseconds
+        res.append("\n{\"name\":\"").append(event.name)
+           .append("\",\"ph\":\"X\",\"pid\":1,\"tid\":").append(QByteArray::number(event.thread))
+           .append(",\"ts\":").append(QByteArray::number(double(event.begin) / 1000.0, 'f', 3))
+           .append(",\"dur\":").append(QByteArray::number(double(event.duration) / 1000.0, 'f', 3))
+           .append(",\"args\":{");
+        for (int m = 0; m < MetricCount; ++m) {
+            if (m > 0)
+                res.append(',');
+            res.append('"').append(metricNames[m]).append("\":").append(QByteArray::number(event.counters[m]));
+        }
+        res.append("}}");
+    }
+    res.append("\n]}\n");
+    if (device.write(res) != res.size())
+        throw Error(QString("Failed to write trace: %1").arg(device.errorString()));
+}
+
+void vn::Trace::saveChromeTrace(const QString &filePath)
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        throw Error(QString("Failed to open %1 for writing: %2").arg(filePath).arg(file.errorString()));
+    writeChromeTrace(file);
+    if (!file.commit())
+        throw Error(QString("Failed to save %1: %2").arg(filePath).arg(file.errorString()));
+}
+
+vn::Trace::Scope::Scope(const char *name) :
+    name_(name)
+{
+    if (!isEnabled())
+        return;
+    for (int m = 0; m < MetricCount; ++m)
+        counters_[m] = Trace::counters_[m];
+    begin_ = now();
+}
+
+vn::Trace::Scope::~Scope()
+{
+    /// NOTE: scopes begun while disabled are not recorded
+    if (begin_ < 0 || !isEnabled())
+        return;
+    Event event;
+    event.name = name_;
+    event.begin = begin_;
+    event.duration = now() - begin_;
+    event.thread = threadIndex();
+    for (int m = 0; m < MetricCount; ++m)
+        event.counters[m] = Trace::counters_[m] - counters_[m];
+
+    Events &e = events();
+    QMutexLocker lock(&e.mutex);
+    if (e.events.size() < maxEvents)
+        e.events.append(event);
+    else
+        e.dropped++;
+}
+
+
+#ifdef VN_TRACE
+
+void *operator new(std::size_t size)
+{
+    vn::Trace::count(vn::Trace::Allocations);
+    if (void *res = std::malloc(size == 0 ? 1 : size))
+        return res;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QIODevice>
+#include <QLoggingCategory>
+#include <QString>
+
+#include <atomic>
+
+
+/// NOTE: instrumentation is built only with VN_TRACE defined
+/// (CONFIG += trace in qmake), otherwise the macros are empty.
+/// when built it is still off until Trace::setEnabled(true),
+/// then each hit costs a load of one flag
+#ifdef VN_TRACE
+#define VN_TRACE_COUNT(metric) ::VisualNovelGraph::Trace::count(::VisualNovelGraph::Trace::metric)
+#define VN_TRACE_SCOPE(name) const ::VisualNovelGraph::Trace::Scope vnTraceScope(name)
+#else
+#define VN_TRACE_COUNT(metric) do {} while (false)
+#define VN_TRACE_SCOPE(name) do {} while (false)
+#endif
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: output of Print and Compute, filtered with QT_LOGGING_RULES,
+/// e.g. "vn.compute.debug=false"
+Q_DECLARE_LOGGING_CATEGORY(lcPrint)
+Q_DECLARE_LOGGING_CATEGORY(lcCompute)
+
+
+/// NOTE: counters are per thread. a scope records a Chrome trace event
+/// with its duration and how much every counter grew inside of it.
+/// allocations are counted by replacing global operator new
+class Trace
+{
+public:
+    enum Metric {
+        Steps,
+        Visits,
+        CacheHits,
+        CacheMisses,
+        Allocations,
+        MetricCount,
+    };
+
+    static void setEnabled(const bool enabled);
+    static inline bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+    static inline void count(const Metric metric)
+    {
+        if (isEnabled())
+            counters_[metric]++;
+    }
+    /// NOTE: of the calling thread
+    static inline quint64 value(const Metric metric) { return counters_[metric]; }
+
+    /// NOTE: drops the recorded events
+    static void clear();
+    /// NOTE: events are kept up to a limit, the rest are only counted
+    static int eventCount();
+    static int droppedCount();
+    /// NOTE: JSON object format of chrome://tracing and Perfetto.
+    /// throws Error if the device can't be written
+    static void writeChromeTrace(QIODevice &device);
+    static void saveChromeTrace(const QString &filePath);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    private:
+        const char *name_;
+        qint64 begin_ = -1;
+        quint64 counters_[MetricCount];
+    };
+
+private:
+    static inline std::atomic<bool> enabled_ {false};
+    static inline thread_local quint64 counters_[MetricCount] = {};
+};
+
+}
+
+#endif // TRACE_H
@@ -0,0 +1,25 @@
+#include "traversal.h"
+
+
+void vn::Traversal::reset(const int idBound)
+{
+    stack_.clear();
+    if (stamps_.size() < idBound)
+        stamps_.resize(idBound);
+
+    /// NOTE: on wrap around old stamps could collide with new ones
+    if (++generation_ == 0) {
+        stamps_.fill(0);
+        generation_ = 1;
+    }
+}
+
+int vn::Traversal::idBound(const Graph &graph)
+{
+    return graph.nodes_.isEmpty() ? 0 : (graph.nodes_.lastKey() + 1);
+}
+
+int vn::Traversal::idBound(const CompiledGraph &graph)
+{
+    return graph.size();
+}
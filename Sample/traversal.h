@@ -0,0 +1,121 @@
+#ifndef TRAVERSAL_H
+#define TRAVERSAL_H
+
+#include <QVector>
+
+#include "headers.h"
+#include "compiledgraph.h"
+#include "dispatch.h"
+#include "trace.h"
+
+
+namespace VisualNovelGraph {
+
+/// NOTE: depth first traversal with an explicit stack, so long chains
+/// don't grow the thread stack. keeps the Visitor contract of recursion:
+/// stepIn/stepOut around every edge, accept and children only on the
+/// first visit, children skipped if shouldStop() right after accept.
+/// visited marks are generation stamps indexed by NodeId, so keeping
+/// one Traversal for repeated runs reuses all of its buffers.
+/// visitor is either a Visitor or a StaticVisitor, the latter is
+/// called without any virtual dispatch on a CompiledGraph
+class Traversal
+{
+public:
+    Traversal() = default;
+    template <typename G, typename V>
+    void run(const G &graph, const NodeId id, V &visitor);
+private:
+    struct Step
+    {
+        NodeId id;
+        int ind;
+    };
+    void reset(const int idBound);
+    template <typename G, typename V>
+    bool enter(const G &graph, const NodeId id, V &visitor);
+    template <typename V>
+    static void accept(const Graph &graph, const NodeId id, const Node &node, V &visitor);
+    template <typename V>
+    static void accept(const CompiledGraph &graph, const NodeId id, const Node &node, V &visitor);
+    static int idBound(const Graph &graph);
+    static int idBound(const CompiledGraph &graph);
+
+    QVector<quint32> stamps_;
+    quint32 generation_ = 0;
+    QVector<Step> stack_;
+};
+
+
+template <typename G, typename V>
+void Traversal::run(const G &graph, const NodeId id, V &visitor)
+{
+    VN_TRACE_SCOPE("traverse");
+    reset(idBound(graph));
+    enter(graph, id, visitor);
+    while (!stack_.isEmpty()) {
+        Step &step = stack_.last();
+        const auto next = graph.next(step.id);
+        if (step.ind >= next.size()) {
+            stack_.pop_back();
+            visitor.stepOut();
+            continue;
+        }
+        const NodeId child = next[step.ind++];
+        enter(graph, child, visitor);
+    }
+}
+
+template <typename G, typename V>
+bool Traversal::enter(const G &graph, const NodeId id, V &visitor)
+{
+    const Node &node = graph.node(id);
+    VN_TRACE_COUNT(Steps);
+    visitor.stepIn(node);
+    if (stamps_[id] == generation_) {
+        visitor.stepOut();
+        return false;
+    }
+
+    stamps_[id] = generation_;
+    VN_TRACE_COUNT(Visits);
+    accept(graph, id, node, visitor);
+
+    if (visitor.shouldStop()) {
+        visitor.stepOut();
+        return false;
+    }
+
+    stack_.push_back({id, 0});
+    return true;
+}
+
+template <typename V>
+void Traversal::accept(const Graph &, const NodeId, const Node &node, V &visitor)
+{
+    /// NOTE: Graph doesn't keep kinds, a Visitor is cheaper through accept
+    if constexpr (std::is_base_of<Visitor, V>::value)
+        node.accept(visitor);
+    else
+        dispatch(node, kindOf(node), visitor);
+}
+
+template <typename V>
+void Traversal::accept(const CompiledGraph &graph, const NodeId id, const Node &node, V &visitor)
+{
+    dispatch(node, graph.kind(id), visitor);
+}
+
+
+/// NOTE: same as traverse with a Visitor, resolved at compile time
+template <typename V>
+void traverseStatic(const CompiledGraph &graph, const NodeId id, V &visitor)
+{
+    static_assert(!std::is_base_of<Visitor, V>::value, "use traverse for a Visitor");
+    Traversal traversal;
+    traversal.run(graph, id, visitor);
+}
+
+}
+
+#endif // TRAVERSAL_H
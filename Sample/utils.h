@@ -19,6 +19,24 @@ constexpr std::size_t variant_index()
     }
 }
 
+
+/// NOTE: non-owning view over a contiguous range,
+/// stays valid as long as the storage it points to
+template <typename T>
+struct Span
+{
+    Span() = default;
+    Span(const T *data, const int size) : data_(data), size_(size) {}
+    inline const T *begin() const                  { return data_; }
+    inline const T *end() const                    { return data_ + size_; }
+    inline const T &operator[](const int ind) const { return data_[ind]; }
+    inline int size() const                        { return size_; }
+    inline bool isEmpty() const                    { return size_ == 0; }
+private:
+    const T *data_ = nullptr;
+    int size_ = 0;
+};
+
 }
 
 #endif // UTILS_H
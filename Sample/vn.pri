@@ -0,0 +1,42 @@
+INCLUDEPATH += $$PWD
+
+# counters and scopes of trace.h, CONFIG += trace to build them in
+trace: DEFINES += VN_TRACE
+
+SOURCES += \
+    $$PWD/arena.cpp \
+    $$PWD/batch.cpp \
+    $$PWD/binary.cpp \
+    $$PWD/bytecode.cpp \
+    $$PWD/compiledgraph.cpp \
+    $$PWD/dot.cpp \
+    $$PWD/explorer.cpp \
+    $$PWD/headers.cpp \
+    $$PWD/incremental.cpp \
+    $$PWD/optimizer.cpp \
+    $$PWD/runtime.cpp \
+    $$PWD/savestate.cpp \
+    $$PWD/simulator.cpp \
+    $$PWD/stringpool.cpp \
+    $$PWD/trace.cpp \
+    $$PWD/traversal.cpp
+
+HEADERS += \
+    $$PWD/arena.h \
+    $$PWD/batch.h \
+    $$PWD/binary.h \
+    $$PWD/bytecode.h \
+    $$PWD/compiledgraph.h \
+    $$PWD/dispatch.h \
+    $$PWD/dot.h \
+    $$PWD/explorer.h \
+    $$PWD/headers.h \
+    $$PWD/incremental.h \
+    $$PWD/optimizer.h \
+    $$PWD/runtime.h \
+    $$PWD/savestate.h \
+    $$PWD/simulator.h \
+    $$PWD/stringpool.h \
+    $$PWD/trace.h \
+    $$PWD/traversal.h \
+    $$PWD/utils.h
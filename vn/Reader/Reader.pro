@@ -2,9 +2,23 @@ QT += gui widgets
 CONFIG += c++11
 CONFIG -= app_bundle console
 
+INCLUDEPATH += ../../Sample
+
 SOURCES += \
+    ../../Sample/savestate.cpp \
+    ../../Sample/stringpool.cpp \
     main.cpp \
+    parser.cpp \
+    prefetcher.cpp \
+    scanner.cpp \
+    story.cpp \
     window.cpp
 
 HEADERS += \
+    ../../Sample/savestate.h \
+    ../../Sample/stringpool.h \
+    parser.h \
+    prefetcher.h \
+    scanner.h \
+    story.h \
     window.h
@@ -0,0 +1,146 @@
+#include "parser.h"
+#include <QtDebug>
+#include <vector>
+#include "scanner.h"
+#include "story.h"
+
+void parseStory(Scanner &scanner, Story &story)
+{
+    struct IParser
+    {
+        virtual ~IParser() = default;
+        virtual int newNode(const Line &line, const Story::Cover cover) = 0;
+        virtual void connect(const int parent, const int child) = 0;
+        virtual void close(const int id) = 0;
+        virtual Line line(const int) const = 0;
+    };
+
+    struct Reader
+    {
+        IParser *parser_ = nullptr;
+        std::vector<int> stack_;
+        bool hasRoot_ = false;
+
+        static Text text(const Line &line)
+        {
+            return Text::fromUtf8(line.begin, int(line.end - line.begin));
+        }
+        /// NOTE: a node gets no children once off the stack
+        void pop()
+        {
+            parser_->close(stack_.back());
+            stack_.pop_back();
+        }
+        void finish()
+        {
+            while (!stack_.empty())
+                pop();
+        }
+        static int last(const std::vector<int> &stack, const int ind = 0)
+        {
+            const int n = stack.size();
+            Q_ASSERT(n > ind);
+            return stack.at(n - 1 - ind);
+        }
+        bool operator()(const Line &line)
+        {
+            if (!hasRoot_) {
+                hasRoot_ = true;
+                const int id = parser_->newNode(line, Story::NoCover);
+                stack_.push_back(id);
+                return true;
+            }
+
+            int lastId_ = last(stack_);
+            const int tab = parser_->line(lastId_).tab;
+            const int tab2 = line.tab;
+            if (tab2 <= tab) {
+                if (tab2 < tab) {
+                    /// NOTE: poping until new tab will match last in stack
+                    /// and it won't be a numeric option
+                    for (;;) {
+                        if (stack_.empty()) {
+                            qWarning() << "Bad tab alignment on returning to previous lines. Failed at "<< text(line);
+                            return false;
+                        }
+                        pop();
+                        lastId_ = last(stack_);
+                        const Line line0 = parser_->line(lastId_);
+                        if (line0.tab <= tab2 && line0.number == -1)
+                            break;
+                    }
+                }
+                const int numStart = parser_->line(lastId_).number;
+                const int numStart2 = line.number;
+                if (numStart2 != -1 && numStart != -1) {
+                    pop();
+                    lastId_ = last(stack_);
+                }
+                const bool isOption = (numStart2 != -1);
+                if (!isOption) {
+                    const int id = parser_->newNode(line, Story::ArrowCover);
+                    parser_->connect(lastId_, id);
+                    pop();
+                    stack_.push_back(id);
+                    return true;
+                }
+                // TODO: remove the number from line. cover is good
+                const int id = parser_->newNode(line, Story::LineCover);
+                parser_->connect(lastId_, id);
+                stack_.push_back(id);
+                return true;
+            }
+            if (tab2 > tab) {
+                /// NOTE: option branch
+                if (parser_->line(lastId_).number == -1) {
+                    qWarning() << "Branch can be only from option. For now at least. Failed at "<< text(line);
+                    return false;
+                }
+                const int id = parser_->newNode(line, Story::ArrowCover);
+                parser_->connect(lastId_, id);
+                stack_.push_back(id);
+                return true;
+            }
+            qWarning() << "not implemented for " << text(line);
+            return false;
+        }
+    } reader;
+
+    struct Parser final : IParser
+    {
+        explicit Parser(Story &story) : story_(story) {}
+        int newNode(const Line &line, const Story::Cover cover) override
+        {
+            lines_.push_back(line);
+            return story_.add(line.begin, line.end, cover);
+        }
+        void connect(const int parent, const int child) override
+        {
+            story_.connect(parent, child);
+        }
+        void close(const int id) override
+        {
+            story_.close(id);
+        }
+        Line line(const int ind) const override
+        {
+            Q_ASSERT(ind < lines_.size());
+            return lines_.at(ind);
+        }
+    private:
+        Story &story_;
+        std::vector<Line> lines_;
+    };
+
+    Parser parser(story);
+    reader.parser_ = &parser;
+
+    Line line;
+    while (!story.isCancelled() && !story.isFull() && scanner.next(line)) {
+        // NOTE: stop parsing if fails
+        if (!reader(line))
+            break;
+    }
+    reader.finish();
+    story.finish();
+}
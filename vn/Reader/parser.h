@@ -0,0 +1,12 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+class Scanner;
+class Story;
+
+/// NOTE: builds story out of the lines of scanner, the first one being
+/// the root. stops at the first line that doesn't fit the indentation,
+/// once story is full or cancelled, and finishes story either way
+void parseStory(Scanner &scanner, Story &story);
+
+#endif // PARSER_H
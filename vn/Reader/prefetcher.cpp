@@ -0,0 +1,102 @@
+#include "prefetcher.h"
+
+#include <QSet>
+#include <QVector>
+
+
+Prefetcher::Prefetcher(const Story &story, const int depth, const int capacity) :
+    story_(story),
+    depth_(depth),
+    cache_(capacity)
+{
+    thread_ = std::thread([this]{ run(); });
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        QMutexLocker lock(&mutex_);
+        stop_ = true;
+        wake_.wakeAll();
+    }
+    thread_.join();
+}
+
+void Prefetcher::focus(const int node)
+{
+    QMutexLocker lock(&mutex_);
+    focus_ = node;
+    generation_++;
+    wake_.wakeAll();
+}
+
+Prepared Prefetcher::get(const int node)
+{
+    {
+        QMutexLocker lock(&mutex_);
+        const Prepared *cached = cache_.object(node);
+        if (cached != nullptr)
+            return *cached;
+    }
+    const Prepared res = prepare(story_, node);
+    QMutexLocker lock(&mutex_);
+    cache_.insert(node, new Prepared(res));
+    return res;
+}
+
+Prepared Prefetcher::prepare(const Story &story, const int node)
+{
+    Prepared res;
+    res.text = story.text(node).trimmed();
+    res.entry = Text("\n%1").arg(res.text);
+    const int count = story.childCount(node);
+    res.labels.reserve(count);
+    for (int i = 0; i < count; ++i)
+        res.labels.append(story.cover(story.child(node, i)));
+    return res;
+}
+
+void Prefetcher::run()
+{
+    QVector<int> layer;
+    QVector<int> nextLayer;
+    QSet<int> seen;
+    quint64 done = 0;
+
+    QMutexLocker lock(&mutex_);
+    for (;;) {
+        while (!stop_ && generation_ == done)
+            wake_.wait(&mutex_);
+        if (stop_)
+            return;
+        const quint64 generation = done = generation_;
+        layer = {focus_};
+        seen = {focus_};
+
+        /// NOTE: breadth first, so the nearest frames are ready first.
+        /// the lock is let go while preparing
+        for (int depth = 0; depth <= depth_ && !layer.isEmpty() && generation_ == generation; ++depth) {
+            nextLayer.clear();
+            for (const int node : layer) {
+                if (stop_ || generation_ != generation)
+                    break;
+                if (!story_.isReady(node))
+                    continue;
+                if (!cache_.contains(node)) {
+                    lock.unlock();
+                    Prepared *prepared = new Prepared(prepare(story_, node));
+                    lock.relock();
+                    cache_.insert(node, prepared);
+                }
+                for (int i = 0; i < story_.childCount(node); ++i) {
+                    const int child = story_.child(node, i);
+                    if (!seen.contains(child)) {
+                        seen.insert(child);
+                        nextLayer.append(child);
+                    }
+                }
+            }
+            std::swap(layer, nextLayer);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <QCache>
+#include <QMutex>
+#include <QStringList>
+#include <QWaitCondition>
+
+#include <thread>
+
+#include "story.h"
+
+
+/// NOTE: everything needed to show a node
+struct Prepared
+{
+    Text text;
+    /// NOTE: as appended to the transcript, QTextEdit::append
+    /// tells whether it's rich text, so inline markup still renders
+    Text entry;
+    QStringList labels;
+};
+
+
+/// NOTE: prepares nodes within depth choices of the focused one on
+/// a worker thread, nearest first, keeping the last capacity of them.
+/// only ready nodes are prepared, the rest are picked up on next focus
+class Prefetcher
+{
+public:
+    explicit Prefetcher(const Story &story, const int depth = 2, const int capacity = 256);
+    Prefetcher(const Prefetcher &) = delete;
+    Prefetcher &operator=(const Prefetcher &) = delete;
+    ~Prefetcher();
+
+    /// NOTE: drops the walk around the previous node
+    void focus(const int node);
+    /// NOTE: from the cache if it's there, prepared in place otherwise.
+    /// node should be ready
+    Prepared get(const int node);
+
+    static Prepared prepare(const Story &story, const int node);
+
+private:
+    void run();
+
+    const Story &story_;
+    const int depth_;
+
+    QMutex mutex_;
+    QWaitCondition wake_;
+    QCache<int, Prepared> cache_;
+    int focus_ = -1;
+    /// NOTE: bumped on every focus, so a walk can see it's stale
+    quint64 generation_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+#endif // PREFETCHER_H
@@ -0,0 +1,71 @@
+#include "scanner.h"
+
+#include <cstring>
+#include <limits>
+
+
+namespace {
+
+inline bool isSpace(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit(const char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+}
+
+
+Scanner::Scanner(const char *begin, const char *end) :
+    pos_(begin),
+    end_(end)
+{}
+
+bool Scanner::next(Line &line)
+{
+    if (pos_ >= end_)
+        return false;
+
+    const void *br = std::memchr(pos_, '\n', end_ - pos_);
+    const char *lineEnd = br ? static_cast<const char *>(br) : end_;
+    line.begin = pos_;
+    line.end = lineEnd;
+    pos_ = br ? lineEnd + 1 : end_;
+
+    /// NOTE: same as QTextStream::readLine for "\r\n" endings
+    if (line.end > line.begin && line.end[-1] == '\r')
+        line.end--;
+
+    line.tab = numberOfSpaces(line.begin, line.end);
+    line.number = line.tab < 0 ? -1 : numberInFront(line.begin + line.tab, line.end);
+    return true;
+}
+
+int Scanner::numberOfSpaces(const char *begin, const char *end)
+{
+    for (const char *c = begin; c != end; ++c)
+        if (!isSpace(*c))
+            return int(c - begin);
+    return -1;
+}
+
+int Scanner::numberInFront(const char *begin, const char *end)
+{
+    const char *c = begin;
+    while (c != end && isSpace(*c))
+        ++c;
+
+    const char *digits = c;
+    long long res = 0;
+    for (; c != end && isDigit(*c); ++c)
+        if (res <= std::numeric_limits<int>::max())
+            res = res * 10 + (*c - '0');
+    if (c == digits || end - c < 2 || c[0] != '.' || c[1] != ' ')
+        return -1;
+
+    /// NOTE: QString::toInt gives zero on overflow
+    return res > std::numeric_limits<int>::max() ? 0 : int(res);
+}
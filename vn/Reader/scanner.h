@@ -0,0 +1,32 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+/// NOTE: one line of a script, without the line break.
+/// bytes point into the scanned buffer
+struct Line
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    /// NOTE: leading whitespace, -1 for a blank line
+    int tab = -1;
+    /// NOTE: option number as in "  12. text", -1 if there is none
+    int number = -1;
+};
+
+
+/// NOTE: splits UTF-8 text into lines in a single pass, measuring
+/// indentation and option numbers on the way. only ASCII whitespace
+/// and digits are recognized
+class Scanner
+{
+public:
+    Scanner(const char *begin, const char *end);
+    bool next(Line &line);
+    static int numberOfSpaces(const char *begin, const char *end);
+    static int numberInFront(const char *begin, const char *end);
+private:
+    const char *pos_ = nullptr;
+    const char *end_ = nullptr;
+};
+
+#endif // SCANNER_H
@@ -0,0 +1,114 @@
+#include "story.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+Story::Story() :
+    chunks_(maxChunks, nullptr)
+{}
+
+Story::~Story()
+{
+    for (Entry *chunk : chunks_)
+        delete[] chunk;
+    for (int *block : blocks_)
+        delete[] block;
+}
+
+Text Story::cover(const int node) const
+{
+    const vn::StringPool::Id id = entry(node).cover;
+    QMutexLocker lock(&stringsMutex_);
+    return strings_.text(id);
+}
+
+Text Story::text(const int node) const
+{
+    const vn::StringPool::Id id = entry(node).text;
+    QMutexLocker lock(&stringsMutex_);
+    return strings_.text(id);
+}
+
+int Story::add(const char *begin, const char *end, const Cover cover)
+{
+    const int node = size_.load(std::memory_order_relaxed);
+    Q_ASSERT(node < capacity);
+    if ((node & (chunkSize - 1)) == 0)
+        chunks_[node >> chunkBits] = new Entry[chunkSize];
+
+    Entry &e = entry(node);
+    {
+        QMutexLocker lock(&stringsMutex_);
+        e.text = strings_.add(begin, int(end - begin));
+        if (cover == ArrowCover && arrow_ == vn::StringPool::none)
+            arrow_ = strings_.add(QByteArray("->"));
+    }
+    switch (cover) {
+    case NoCover:
+        e.cover = vn::StringPool::none;
+        break;
+    case ArrowCover:
+        e.cover = arrow_;
+        break;
+    case LineCover:
+        e.cover = e.text;
+        break;
+    }
+    size_.store(node + 1, std::memory_order_release);
+    return node;
+}
+
+void Story::connect(const int parent, const int child)
+{
+    Q_ASSERT(parent < size());
+    Q_ASSERT(child < size());
+    Q_ASSERT(!entry(parent).ready.load());
+    open_[parent].append(child);
+}
+
+void Story::close(const int node)
+{
+    Entry &e = entry(node);
+    if (e.ready.load(std::memory_order_relaxed))
+        return;
+    const auto it = open_.find(node);
+    if (it != open_.end()) {
+        int *children = place(it.value().size());
+        std::copy(it.value().cbegin(), it.value().cend(), children);
+        e.children = children;
+        e.count = it.value().size();
+        open_.erase(it);
+    }
+    e.ready.store(true, std::memory_order_release);
+}
+
+void Story::finish()
+{
+    const int n = size_.load(std::memory_order_relaxed);
+    for (int node = 0; node < n; ++node)
+        close(node);
+    open_.clear();
+    {
+        QMutexLocker lock(&stringsMutex_);
+        strings_.squeeze();
+    }
+    complete_.store(true, std::memory_order_release);
+}
+
+int *Story::place(const int count)
+{
+    /// NOTE: blocks are never moved, readers keep pointers into them
+    if (count > blockSize) {
+        blocks_.append(new int[size_t(count)]);
+        return blocks_.last();
+    }
+    if (block_ == nullptr || blockUsed_ + count > blockSize) {
+        block_ = new int[blockSize];
+        blocks_.append(block_);
+        blockUsed_ = 0;
+    }
+    int *res = block_ + blockUsed_;
+    blockUsed_ += count;
+    return res;
+}
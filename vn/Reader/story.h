@@ -0,0 +1,120 @@
+#ifndef STORY_H
+#define STORY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+#include "stringpool.h"
+
+using Text = QString;
+
+
+/// NOTE: story of the Reader in flat arrays, node 0 is the root.
+/// all text is interned UTF-8, so repeated lines are kept once and
+/// decoded only when asked for. navigation is an index lookup,
+/// nothing is allocated or counted.
+///
+/// one thread builds it while others read. nodes live in chunks which
+/// never move and are published by size(). a node becomes ready once
+/// closed, when its children are known for good: only then childCount
+/// and child may be called for it
+class Story
+{
+public:
+    enum Cover {
+        NoCover,
+        ArrowCover,
+        LineCover,
+    };
+
+    Story();
+    Story(const Story &) = delete;
+    Story &operator=(const Story &) = delete;
+    ~Story();
+
+    inline int size() const         { return size_.load(std::memory_order_acquire); }
+    inline bool isEmpty() const     { return size() == 0; }
+    inline int root() const         { return 0; }
+    inline bool isComplete() const  { return complete_.load(std::memory_order_acquire); }
+    inline bool isFull() const      { return size() == capacity; }
+    inline bool isReady(const int node) const
+    {
+        return node >= 0 && node < size() && entry(node).ready.load(std::memory_order_acquire);
+    }
+    inline int childCount(const int node) const
+    {
+        Q_ASSERT(isReady(node));
+        return entry(node).count;
+    }
+    /// NOTE: -1 if there is no such child
+    inline int child(const int node, const int ind) const
+    {
+        Q_ASSERT(isReady(node));
+        const Entry &e = entry(node);
+        return (ind < 0 || ind >= e.count) ? -1 : e.children[ind];
+    }
+    Text cover(const int node) const;
+    Text text(const int node) const;
+
+    /// NOTE: building from one thread, nodes are added in order
+    /// and get their children until closed. finish() closes the rest
+    int add(const char *begin, const char *end, const Cover cover);
+    void connect(const int parent, const int child);
+    void close(const int node);
+    void finish();
+
+    /// NOTE: asks the builder to stop early
+    inline void cancel()                { cancelled_.store(true); }
+    inline bool isCancelled() const     { return cancelled_.load(); }
+
+private:
+    struct Entry
+    {
+        vn::StringPool::Id text = vn::StringPool::none;
+        vn::StringPool::Id cover = vn::StringPool::none;
+        const int *children = nullptr;
+        int count = 0;
+        std::atomic<bool> ready {false};
+    };
+
+    static const int chunkBits = 12;
+    static const int chunkSize = 1 << chunkBits;
+    static const int maxChunks = 1 << 14;
+    static const int capacity = maxChunks * chunkSize;
+    static const int blockSize = 16 * 1024;
+
+    inline const Entry &entry(const int node) const
+    {
+        return chunks_[node >> chunkBits][node & (chunkSize - 1)];
+    }
+    inline Entry &entry(const int node)
+    {
+        return chunks_[node >> chunkBits][node & (chunkSize - 1)];
+    }
+    int *place(const int count);
+
+    /// NOTE: sized once, so readers can index it while chunks are added
+    QVector<Entry *> chunks_;
+    std::atomic<int> size_ {0};
+    std::atomic<bool> complete_ {false};
+    std::atomic<bool> cancelled_ {false};
+
+    /// NOTE: pool is shared between builder and readers
+    mutable QMutex stringsMutex_;
+    vn::StringPool strings_;
+    vn::StringPool::Id arrow_ = vn::StringPool::none;
+
+    /// NOTE: builder only. children of open nodes, and blocks
+    /// of children of closed ones
+    QHash<int, QVector<int>> open_;
+    QVector<int *> blocks_;
+    int *block_ = nullptr;
+    int blockUsed_ = 0;
+};
+
+#endif // STORY_H
@@ -1,8 +1,12 @@
 #include "window.h"
 #include <QScrollArea>
+#include <QTextCursor>
+#include <QTextDocument>
 #include <QFile>
+#include <QSaveFile>
 #include <QtDebug>
-#include <QTextStream>
+#include "scanner.h"
+#include "parser.h"
 
 Window::Window(QWidget *parent) : QMainWindow(parent)
 {
@@ -11,6 +15,14 @@ Window::Window(QWidget *parent) : QMainWindow(parent)
     widgetText_->setReadOnly(true);
     widgetText_->clear();
 
+    widgetEarlier_ = new QPushButton("Earlier");
+    widgetEarlier_->setEnabled(false);
+    connect(widgetEarlier_, &QPushButton::clicked, this, [this]{ showEarlier(); });
+
+    widgetBack_ = new QPushButton("Back");
+    widgetBack_->setEnabled(false);
+    connect(widgetBack_, &QPushButton::clicked, this, [this]{ onBack(); });
+
     auto *sa1 = new QScrollArea;
     sa1->setWidget(widgetText_);
     sa1->setWidgetResizable(true);
@@ -24,7 +36,12 @@ Window::Window(QWidget *parent) : QMainWindow(parent)
     sa2->setWidget(q);
     sa2->setWidgetResizable(true);
 
+    auto *top = new QHBoxLayout;
+    top->addWidget(widgetEarlier_);
+    top->addWidget(widgetBack_);
+
     auto *l = new QVBoxLayout;
+    l->addLayout(top);
     l->addWidget(sa1, 2);
     l->addWidget(sa2, 1);
 
@@ -33,213 +50,225 @@ Window::Window(QWidget *parent) : QMainWindow(parent)
     setCentralWidget(w);
 
     /// read
-    root_ = readTree("/home/pl/jff/vngraph/vn/script.md");
+    timerParsed_ = new QTimer(this);
+    timerParsed_->setInterval(15);
+    connect(timerParsed_, &QTimer::timeout, this, [this]{ onParsed(); });
+    const FilePath scriptPath = "/home/pl/jff/vngraph/vn/script.md";
+    parser_ = std::thread([this, scriptPath]{ readTree(scriptPath, story_); });
+
+    /// continue from the last autosave, if any
+    timerSave_ = new QTimer(this);
+    timerSave_->setSingleShot(true);
+    timerSave_->setInterval(500);
+    connect(timerSave_, &QTimer::timeout, this, [this]{ save(); });
+    savePath_ = scriptPath + ".save";
+    vn::SaveState state;
+    state.node = story_.root();
+    QFile saved(savePath_);
+    if (saved.open(QIODevice::ReadOnly) && !vn::loadState(saved.readAll(), state))
+        qWarning() << "Broken save" << savePath_ << "starting over";
+    states_.reset(state);
 
     /// step
-    printNode(this, root_);
+    node_ = state.node;
+    showNode(node_);
+}
+
+Window::~Window()
+{
+    save();
+    story_.cancel();
+    parser_.join();
 }
 
 void Window::onClicked(const int ind)
 {
-    root_ = root_->next(ind);
-    printNode(this, root_);
+    node_ = story_.child(node_, ind);
+    vn::SaveState state = states_.current();
+    state.node = node_;
+    state.choices.append(ind);
+    states_.push(state);
+    autosave();
+    showNode(node_);
+}
+
+void Window::onBack()
+{
+    if (!states_.rewind(1))
+        return;
+    node_ = states_.current().node;
+    autosave();
+    showNode(node_);
+}
+
+void Window::autosave()
+{
+    unsaved_ = true;
+    if (!timerSave_->isActive())
+        timerSave_->start();
+}
+
+void Window::save()
+{
+    if (!unsaved_)
+        return;
+    unsaved_ = false;
+    timerSave_->stop();
+    QSaveFile file(savePath_);
+    if (!file.open(QIODevice::WriteOnly)
+            || file.write(vn::saveState(states_.current())) < 0
+            || !file.commit())
+        qWarning() << "Failed to autosave" << savePath_ << file.errorString();
+}
+
+void Window::showNode(const int node)
+{
+    widgetBack_->setEnabled(states_.depth() > 0);
+    if (story_.isReady(node)) {
+        timerParsed_->stop();
+        printNode(this, node);
+        return;
+    }
+    /// NOTE: no choices until the node is parsed
+    for (auto *b : widgetButtons_)
+        b->setVisible(false);
+    timerParsed_->start();
+}
+
+void Window::onParsed()
+{
+    if (story_.isReady(node_)) {
+        showNode(node_);
+        return;
+    }
+    if (!story_.isComplete())
+        return;
+    timerParsed_->stop();
+    /// NOTE: a save left by an older script may point past its end
+    if (node_ != story_.root() && story_.isReady(story_.root())) {
+        qWarning() << "Node" << node_ << "is missing in the script, starting over";
+        vn::SaveState state;
+        state.node = story_.root();
+        states_.reset(state);
+        node_ = state.node;
+        autosave();
+        showNode(node_);
+        return;
+    }
+    qWarning() << "Node" << node_ << "is missing in the script";
 }
 
-Ptr<INode> Window::readTree(const FilePath &filePath)
+void Window::readTree(const FilePath &filePath, Story &story)
 {
     QFile inputFile(filePath);
     if (!inputFile.open(QIODevice::ReadOnly))
-        return nullptr;
-    QTextStream in(&inputFile);
-    struct IParser
-    {
-        virtual ~IParser() = default;
-        virtual int newNode(const Text &cover, const Text &text) = 0;
-        virtual void connect(const int parent, const int child) = 0;
-        virtual Text line(const int) const = 0;
-    };
+        return story.finish();
+    const qint64 size = inputFile.size();
+    const uchar *data = size > 0 ? inputFile.map(0, size) : nullptr;
+    if (data == nullptr)
+        return story.finish();
+    const char *begin = reinterpret_cast<const char *>(data);
+    Scanner scanner(begin, begin + size);
 
-    struct Reader
-    {
-        IParser *parser_ = nullptr;
-        std::vector<int> stack_;
-        bool hasRoot_ = false;
+    /// tests for Scanner::numberOfSpaces
+    const auto numberOfSpaces = [](const char *line) {
+        return Scanner::numberOfSpaces(line, line + qstrlen(line));
+    };
+    Q_ASSERT(numberOfSpaces("ok") == 0);
+    Q_ASSERT(numberOfSpaces("  ok") == 2);
+    Q_ASSERT(numberOfSpaces("    ok") == 4);
+    Q_ASSERT(numberOfSpaces("    yes yes") == 4);
+    Q_ASSERT(numberOfSpaces(" ") == -1);
+    Q_ASSERT(numberOfSpaces("") == -1);
 
-        static int numberOfSpaces(const Text &line)
-        {
-            return line.indexOf(QRegExp("[^\\s]"));
-        }
-        static int numberInFront(const Text &line)
-        {
-            const int ind = line.indexOf(QRegExp("^\\s*\\d+\\. "));
-            if (ind < 0)
-                return -1;
-            return line.mid(0, line.indexOf(". ")).toInt();
-        }
-        static int last(const std::vector<int> &stack, const int ind = 0)
-        {
-            const int n = stack.size();
-            Q_ASSERT(n > ind);
-            return stack.at(n - 1 - ind);
-        }
-        bool operator()(const Text &line)
-        {
-            if (!hasRoot_) {
-                hasRoot_ = true;
-                const int id = parser_->newNode("", line);
-                stack_.push_back(id);
-                return true;
-            }
-
-            int lastId_ = last(stack_);
-            const int tab = numberOfSpaces(parser_->line(lastId_));
-            const int tab2 = numberOfSpaces(line);
-            if (tab2 <= tab) {
-                if (tab2 < tab) {
-                    /// NOTE: poping until new tab will match last in stack
-                    /// and it won't be a numeric option
-                    for (;;) {
-                        if (stack_.empty()) {
-                            qWarning() << "Bad tab alignment on returning to previous lines. Failed at "<< line;
-                            return false;
-                        }
-                        stack_.pop_back();
-                        lastId_ = last(stack_);
-                        const int tab0 = numberOfSpaces(parser_->line(lastId_));
-                        const int num0 = numberInFront(parser_->line(lastId_));
-                        if (tab0 <= tab2 && num0 == -1)
-                            break;
-                    }
-                }
-                const int numStart = numberInFront(parser_->line(lastId_));
-                const int numStart2 = numberInFront(line);
-                if (numStart2 != -1 && numStart != -1) {
-                    stack_.pop_back();
-                    lastId_ = last(stack_);
-                }
-                const bool isOption = (numStart2 != -1);
-                if (!isOption) {
-                    const int id = parser_->newNode("->", line);
-                    parser_->connect(lastId_, id);
-                    stack_.pop_back();
-                    stack_.push_back(id);
-                    return true;
-                }
-                // TODO: remove the number from line. cover is good
-                const int id = parser_->newNode(line, line);
-                parser_->connect(lastId_, id);
-                stack_.push_back(id);
-                return true;
-            }
-            if (tab2 > tab) {
-                /// NOTE: option branch
-                if (numberInFront(parser_->line(lastId_)) == -1) {
-                    qWarning() << "Branch can be only from option. For now at least. Failed at "<< line;
-                    return false;
-                }
-                const int id = parser_->newNode("->", line);
-                parser_->connect(lastId_, id);
-                stack_.push_back(id);
-                return true;
-            }
-            qWarning() << "not implemented for " << line;
-            return false;
-        }
-    } reader;
-
-    struct Parser final : IParser
-    {
-        int newNode(const Text &cover, const Text &text) override
-        {
-            Ptr<Node> n(new Node);
-            n->cover_ = cover;
-            n->text_ = text;
-            nodes_.push_back(n);
-            return nodes_.size() - 1;
-        }
-        void connect(const int parent, const int child) override
-        {
-            Q_ASSERT(parent < nodes_.size());
-            Q_ASSERT(child < nodes_.size());
-            nodes_.at(parent)->nodes_.push_back(nodes_.at(child));
-        }
-        Text line(const int ind) const override
-        {
-            Q_ASSERT(ind < nodes_.size());
-            return nodes_.at(ind)->text();
-        }
-        inline Ptr<INode> res() const
-        {
-            return nodes_.empty() ? nullptr : nodes_.at(0);
-        }
-    private:
-        std::vector<Ptr<Node>> nodes_;
+    /// tests for Scanner::numberInFront
+    const auto numberInFront = [](const char *line) {
+        return Scanner::numberInFront(line, line + qstrlen(line));
     };
+    Q_ASSERT(numberInFront("") == -1);
+    Q_ASSERT(numberInFront("ok") == -1);
+    Q_ASSERT(numberInFront("  ok") == -1);
+    Q_ASSERT(numberInFront("  a. ok") == -1);
+    Q_ASSERT(numberInFront("  123.ok") == -1);
+    Q_ASSERT(numberInFront("  123 .ok") == -1);
+    Q_ASSERT(numberInFront("  123 . ok") == -1);
+    Q_ASSERT(numberInFront("  123. ok") == 123);
+    Q_ASSERT(numberInFront("5. ok") == 5);
+    Q_ASSERT(numberInFront("    13. ok 14") == 13);
+    Q_ASSERT(numberInFront("  42. 1. 2. 3") == 42);
+    Q_UNUSED(numberOfSpaces)
+    Q_UNUSED(numberInFront)
 
-    Parser parser;
-    reader.parser_ = &parser;
-
-    /// tests for Reader::numberOfSpaces
-    Q_ASSERT(Reader::numberOfSpaces("ok") == 0);
-    Q_ASSERT(Reader::numberOfSpaces("  ok") == 2);
-    Q_ASSERT(Reader::numberOfSpaces("    ok") == 4);
-    Q_ASSERT(Reader::numberOfSpaces("    yes yes") == 4);
-    Q_ASSERT(Reader::numberOfSpaces(" ") == -1);
-    Q_ASSERT(Reader::numberOfSpaces("") == -1);
-
-    /// tests for Reader::numberInFront
-    Q_ASSERT(Reader::numberInFront("") == -1);
-    Q_ASSERT(Reader::numberInFront("ok") == -1);
-    Q_ASSERT(Reader::numberInFront("  ok") == -1);
-    Q_ASSERT(Reader::numberInFront("  a. ok") == -1);
-    Q_ASSERT(Reader::numberInFront("  123.ok") == -1);
-    Q_ASSERT(Reader::numberInFront("  123 .ok") == -1);
-    Q_ASSERT(Reader::numberInFront("  123 . ok") == -1);
-    Q_ASSERT(Reader::numberInFront("  123. ok") == 123);
-    Q_ASSERT(Reader::numberInFront("5. ok") == 5);
-    Q_ASSERT(Reader::numberInFront("    13. ok 14") == 13);
-    Q_ASSERT(Reader::numberInFront("  42. 1. 2. 3") == 42);
-
-    while (!in.atEnd()) {
-        const Text line = in.readLine();
-        // NOTE: stop parsing if fails
-        if (!reader(line))
-            break;
-    }
+    parseStory(scanner, story);
     inputFile.close();
-    return parser.res();
 }
 
-void Window::printNode(Window *w, Ptr<INode> root)
+void Window::printNode(Window *w, const int node)
 {
-    if (root != nullptr) {
-        /// clear previous data
-        for (auto *b : w->widgetButtons_) {
-            w->layoutButtons_->removeWidget(b);
-            b->setParent(nullptr);
-            delete b;
-        }
-        w->widgetButtons_.clear();
-
+    if (node >= 0) {
         /// add new data
-        w->widgetText_->append(Text("\n%1").arg(root->text().trimmed()));
+        w->history_.push_back(node);
+        const int shown = w->transcriptFirst_ + w->frameBlocks_.size();
+        if (shown == w->history_.size() - 1)
+            w->appendFrame(node);
+        else
+            w->showTranscript(w->history_.size() - transcriptFrames);
 
-        for (int i = 0;; ++i) {
-            Ptr<INode> next = root->next(i);
-            if (next == nullptr)
-                break;
-            const Text cover = next->cover();
+        const Prepared prepared = w->prefetcher_.get(node);
+        w->prefetcher_.focus(node);
+        const int count = prepared.labels.size();
+        for (int i = w->widgetButtons_.size(); i < count; ++i) {
             auto *b = new QPushButton(w);
-            b->setText(cover);
-
             w->widgetButtons_.push_back(b);
             w->layoutButtons_->addWidget(b);
             connect(b, &QPushButton::clicked, w, [w, i]{ w->onClicked(i); });
         }
+        for (int i = 0; i < w->widgetButtons_.size(); ++i) {
+            QPushButton *b = w->widgetButtons_.at(i);
+            if (i < count)
+                b->setText(prepared.labels.at(i));
+            b->setVisible(i < count);
+        }
+    }
+}
+
+void Window::appendFrame(const int node)
+{
+    QTextDocument *document = widgetText_->document();
+    /// NOTE: append() fills the only block of an empty document and
+    /// starts a new block otherwise. frames before that left no text,
+    /// so the block is all the new one's
+    const int first = document->isEmpty() ? 0 : document->blockCount();
+    if (first == 0)
+        frameBlocks_.fill(0);
+    widgetText_->append(prefetcher_.get(node).entry);
+    frameBlocks_.push_back(document->blockCount() - first);
+
+    /// NOTE: oldest frames leave the view, so relayout stays bounded
+    while (frameBlocks_.size() > transcriptFrames) {
+        QTextCursor cursor(document);
+        cursor.movePosition(QTextCursor::Start);
+        cursor.movePosition(QTextCursor::NextBlock, QTextCursor::KeepAnchor, frameBlocks_.first());
+        cursor.removeSelectedText();
+        frameBlocks_.removeFirst();
+        transcriptFirst_++;
     }
+    widgetEarlier_->setEnabled(transcriptFirst_ > 0);
+}
+
+void Window::showTranscript(const int first)
+{
+    widgetText_->clear();
+    frameBlocks_.clear();
+    transcriptFirst_ = qMax(0, first);
+    const int last = qMin(transcriptFirst_ + transcriptFrames, history_.size());
+    for (int i = transcriptFirst_; i < last; ++i)
+        appendFrame(history_.at(i));
+    widgetEarlier_->setEnabled(transcriptFirst_ > 0);
 }
 
-Ptr<INode> Node::next(const int ind)
+void Window::showEarlier()
 {
-    return (ind >= nodes_.size()) ? nullptr : nodes_.at(ind);
+    /// NOTE: the latest frames come back on the next choice
+    showTranscript(transcriptFirst_ - transcriptFrames / 2);
 }
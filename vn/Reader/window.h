@@ -1,49 +1,68 @@
 #ifndef WINDOW_H
 #define WINDOW_H
 
-#include <memory>
 #include <QMainWindow>
 #include <QPushButton>
 #include <QTextEdit>
 #include <QBoxLayout>
+#include <QTimer>
+#include <thread>
+#include "story.h"
+#include "prefetcher.h"
+#include "savestate.h"
 
-template <typename T>
-using Ptr = std::shared_ptr<T>;
-using Text = QString;
 using FilePath = QString;
 
-struct INode
-{
-    virtual ~INode() = default;
-    virtual Text cover() const = 0;
-    virtual Text text() const = 0;
-    virtual Ptr<INode> next(const int ind) = 0;
-};
-
-struct Node final : INode
-{
-    Text cover_;
-    Text text_;
-    std::vector<Ptr<INode>> nodes_;
-    inline Text cover() const override { return cover_; }
-    inline Text text() const override { return text_; }
-    Ptr<INode> next(const int ind) override;
-};
-
 
 class Window : public QMainWindow
 {
     Q_OBJECT
 public:
     explicit Window(QWidget *parent = nullptr);
+    ~Window() override;
 
 private:
-    static Ptr<INode> readTree(const FilePath &filePath);
-    static void printNode(Window *w, Ptr<INode> root);
+    static void readTree(const FilePath &filePath, Story &story);
+    static void printNode(Window *w, const int node);
     void onClicked(const int ind);
+    void showNode(const int node);
+    void onParsed();
+    void appendFrame(const int node);
+    void showTranscript(const int first);
+    void showEarlier();
+    void onBack();
+    void autosave();
+    void save();
+
+    /// NOTE: frames kept in the text view, older ones are paged
+    /// back from history_ on demand
+    static constexpr int transcriptFrames = 200;
+
+    /// NOTE: parsed on parser_ while shown, a node not ready yet
+    /// is polled by timerParsed_ without blocking the UI
+    Story story_;
+    Prefetcher prefetcher_ {story_};
+    std::thread parser_;
+    QTimer *timerParsed_ = nullptr;
+    int node_ = -1;
+    /// NOTE: recent steps for going back, the latest one is
+    /// written to savePath_ by timerSave_ shortly after a move,
+    /// so a burst of moves costs one write
+    vn::StateRing states_;
+    FilePath savePath_;
+    QTimer *timerSave_ = nullptr;
+    bool unsaved_ = false;
+    /// NOTE: every node shown so far, the whole playthrough
+    QVector<int> history_;
+    /// NOTE: index in history_ of the first frame in the text view
+    /// and the number of text blocks taken by each frame in it
+    int transcriptFirst_ = 0;
+    QVector<int> frameBlocks_;
 
-    Ptr<INode> root_ = nullptr;
     QTextEdit *widgetText_ = nullptr;
+    QPushButton *widgetEarlier_ = nullptr;
+    QPushButton *widgetBack_ = nullptr;
+    /// NOTE: pool, buttons are reused and extra ones only hidden
     QVector<QPushButton *> widgetButtons_;
     QBoxLayout *layoutButtons_ = nullptr;
 };